@@ -0,0 +1,348 @@
+/**
+ * @file bench.cpp
+ * @brief Synthetic load for the driver with no TourBox attached. A pty
+ *        pair stands in for the serial port: a generator thread writes
+ *        TourBox byte patterns into the master at a set rate while the
+ *        usual event loop reads the slave through the same tourbox_driver
+ *        the daemon uses. Reports go to the null sink unless --sink asks
+ *        for uinput, a file or memory. --loop io_uring runs the same load
+ *        on the io_uring backend; the syscalls the loop thread made per
+ *        event are printed either way.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+// Local
+#include "uinput_helper.h"
+#include "event_loop.h"
+#include "driver.h"
+#include "latency.h"
+
+#define BENCH_SENT_SLOTS (1u << 20)   // Send times kept per byte, well past what a pty buffers
+
+enum bench_pattern { PATTERN_ROTARY, PATTERN_CLICKS, PATTERN_MASH, PATTERN_MIXED };
+static constexpr const char *patternNames[] = {"rotary", "clicks", "mash", "mixed"};
+
+// Rotary bursts: the wheel, dial and knob spun in both directions
+static constexpr uint8_t rotaryBytes[] = {
+    WHEEL_UP, WHEEL_UP | 0x80, WHEEL_UP, WHEEL_UP | 0x80,
+    WHEEL_DOWN, WHEEL_DOWN | 0x80,
+    DIAL_CLOCK, DIAL_CLOCK, DIAL_COUNTER,
+    KNOB_CLOCK, KNOB_CLOCK | 0x80, KNOB_COUNTER,
+};
+// Double clicks: the single press followed by the device's double code
+static constexpr uint8_t clickBytes[] = {
+    TOP, DBL_TOP, RING, DBL_RING, SIDE, DBL_SIDE, PINKIE, DBL_PINKIE,
+};
+// Mashed buttons: press and release of everything that holds, plus taps
+static constexpr uint8_t mashBytes[] = {
+    NINTENDO_A, NINTENDO_A | 0x80, NINTENDO_B, NINTENDO_B | 0x80,
+    MOON, MOON | 0x80, KNOB_PRESS, KNOB_PRESS | 0x80,
+    DIAL_PRESS, DIAL_PRESS | 0x80, WHEEL_PRESS, WHEEL_PRESS | 0x80,
+    DPAD_UP, DPAD_DOWN, DPAD_LEFT, DPAD_RIGHT,
+};
+
+struct bench_options {
+    bench_pattern pattern = PATTERN_MIXED;
+    double rate = 2000;          // Bytes per second, 0 = as fast as the pty takes them
+    double seconds = 5;
+    unsigned burst = 8;          // Bytes per write()
+    const char *sink = "null";
+};
+
+struct bench_state {
+    bench_options opt;
+    int masterFd = -1;
+    int doneFd = -1;             // eventfd: the generator has finished
+    int drainFd = -1;            // timerfd: let the last bytes and click timers settle
+    std::atomic<uint64_t> sent{0};
+    std::array<std::atomic<uint64_t>, BENCH_SENT_SLOTS> sentNs;
+    uint64_t received = 0;
+    latency_histogram transit;   // write() to master -> report flushed
+    uint64_t startNs = 0;
+    uint64_t endNs = 0;
+};
+
+static event_loop gLoop;
+static tourbox_driver gDriver;
+static serial_reader gReader;    // --threads
+static latency_stats gLatency;
+static bench_state gBench;
+
+uint8_t patternByte(bench_pattern pattern, uint64_t i)
+{
+    switch (pattern) {
+      case PATTERN_ROTARY: return rotaryBytes[i % sizeof(rotaryBytes)];
+      case PATTERN_CLICKS: return clickBytes[i % sizeof(clickBytes)];
+      case PATTERN_MASH:   return mashBytes[i % sizeof(mashBytes)];
+      case PATTERN_MIXED:  break;
+    }
+    // Mixed: a run of each, changing every 64 bytes
+    return patternByte(static_cast<bench_pattern>((i / 64) % PATTERN_MIXED), i);
+}
+
+void generator(bench_state &b)
+{
+    const uint64_t startNs = monotonicNs();
+    const uint64_t stopNs = startNs + (uint64_t)(b.opt.seconds * 1e9);
+    uint8_t buf[256];
+    uint64_t n = 0;
+    for (uint64_t nowNs = startNs; nowNs < stopNs; nowNs = monotonicNs()) {
+        if (b.opt.rate > 0) {    // Hold to the requested rate
+            const uint64_t dueNs = startNs + (uint64_t)(n / b.opt.rate * 1e9);
+            if (dueNs > nowNs) {
+                const uint64_t waitNs = dueNs - nowNs;
+                struct timespec ts = {(time_t)(waitNs / 1000000000ULL), (long)(waitNs % 1000000000ULL)};
+                nanosleep(&ts, nullptr);
+            }
+        }
+        for (unsigned i = 0; i < b.opt.burst; i++)
+            buf[i] = patternByte(b.opt.pattern, n + i);
+        const uint64_t sendNs = monotonicNs();
+        for (unsigned i = 0; i < b.opt.burst; i++)   // Stamped before the write so
+            b.sentNs[(n + i) & (BENCH_SENT_SLOTS - 1)].store(sendNs, std::memory_order_release); // the reader never sees a byte first
+        const ssize_t written = write(b.masterFd, buf, b.opt.burst);
+        if (written <= 0)
+            break;
+        n += written;
+        b.sent.store(n, std::memory_order_release);
+    }
+    const uint64_t one = 1;
+    if (write(b.doneFd, &one, sizeof(one)) != sizeof(one))
+        perror("eventfd");
+}
+
+// Times each byte from the generator's write() to the flush that carried
+// its report.
+void benchReceived(void)
+{
+    const uint64_t nowNs = monotonicNs();
+    const uint64_t upTo = gDriver.stats.bytes;
+    for (; gBench.received < upTo; gBench.received++) {
+        const uint64_t sendNs = gBench.sentNs[gBench.received & (BENCH_SENT_SLOTS - 1)].load(std::memory_order_acquire);
+        const uint64_t ns = nowNs - sendNs;
+        gBench.transit.counts[latencyBucket(ns)]++;
+        gBench.transit.samples++;
+        if (ns > gBench.transit.maxNs)
+            gBench.transit.maxNs = ns;
+    }
+}
+
+// Wrap the daemon's serial handlers, on the loop or fed by a reader thread
+void onBenchSerial(loop_handler &h, uint32_t events)
+{
+    driverSerial(h, events);
+    benchReceived();
+}
+
+void onBenchChunks(loop_handler &h, uint32_t events)
+{
+    driverChunks(h, events);
+    benchReceived();
+}
+
+void onBenchRead(loop_handler &h, const uint8_t *data, ssize_t n)
+{
+    driverRead(h, data, n);
+    benchReceived();
+}
+
+// read- and write-like syscalls this thread has made. Work io_uring does
+// on our behalf is not counted, which is the point.
+uint64_t benchSyscalls(void)
+{
+    uint64_t total = 0;
+    FILE *f = fopen("/proc/thread-self/io", "r");
+    if (f == nullptr)
+        return 0;
+    char line[64];
+    unsigned long long n;
+    while (fgets(line, sizeof(line), f) != nullptr)
+        if (sscanf(line, "syscr: %llu", &n) == 1 || sscanf(line, "syscw: %llu", &n) == 1)
+            total += n;
+    fclose(f);
+    return total;
+}
+
+void onGeneratorDone(loop_handler &h, uint32_t /*events*/)
+{
+    uint64_t count;
+    if (read(h.fd, &count, sizeof(count)) != sizeof(count))
+        return;
+    gBench.endNs = monotonicNs();
+    timerArm(gBench.drainFd, 2 * DBL_CLICK_WINDOW_NS + 50000000L);
+}
+
+void onDrained(loop_handler &h, uint32_t /*events*/)
+{
+    if (timerAck(h.fd))
+        loopStop(gLoop);
+}
+
+// Raw pty pair; the slave is opened just like the daemon opens the tty.
+int openPty(int &masterFd, int &slaveFd)
+{
+    masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (masterFd < 0 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0) {
+        perror("posix_openpt");
+        return -1;
+    }
+    const char *slave = ptsname(masterFd);
+    slaveFd = (slave != nullptr) ? open(slave, O_RDWR | O_NOCTTY | O_NONBLOCK) : -1;
+    if (slaveFd < 0) {
+        perror("pty slave");
+        return -1;
+    }
+    struct termios term_options;
+    if (tcgetattr(slaveFd, &term_options) != 0)
+        return -1;
+    cfmakeraw(&term_options);     // No line discipline between the bytes and us
+    return tcsetattr(slaveFd, TCSANOW, &term_options);
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--pattern rotary|clicks|mash|mixed] [--rate BYTES_PER_S] [--seconds S] [--burst N] [--sink SINK]\n"
+                    "          [--coalesce-hz HZ] [--threads] [--loop epoll|io_uring]\n"
+                    "  --rate 0 writes as fast as the pty accepts\n"
+                    "  --coalesce-hz merges rotary detents into at most one report per frame\n"
+                    "  --threads reads the pty on a thread of its own, as the daemon's --threads does\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_options &opt = gBench.opt;
+    int coalesceHz = 0;
+    bool threads = false;
+    loop_backend backend = LOOP_EPOLL;
+    for (int i = 1; i < argc; i++) {
+      if (0 == strcmp(argv[i], "--pattern") && i + 1 < argc) {
+        const char *name = argv[++i];
+        int p = PATTERN_ROTARY;
+        while (p <= PATTERN_MIXED && 0 != strcmp(name, patternNames[p]))
+          p++;
+        if (p > PATTERN_MIXED) {
+          usage(argv[0]);
+          return 1;
+        }
+        opt.pattern = static_cast<bench_pattern>(p);
+      }
+      else if (0 == strcmp(argv[i], "--rate") && i + 1 < argc)
+        opt.rate = atof(argv[++i]);
+      else if (0 == strcmp(argv[i], "--seconds") && i + 1 < argc)
+        opt.seconds = atof(argv[++i]);
+      else if (0 == strcmp(argv[i], "--burst") && i + 1 < argc)
+        opt.burst = atoi(argv[++i]);
+      else if (0 == strcmp(argv[i], "--sink") && i + 1 < argc)
+        opt.sink = argv[++i];
+      else if (0 == strcmp(argv[i], "--coalesce-hz") && i + 1 < argc)
+        coalesceHz = atoi(argv[++i]);
+      else if (0 == strcmp(argv[i], "--threads"))
+        threads = true;
+      else if (0 == strcmp(argv[i], "--loop") && i + 1 < argc) {
+        const char *name = argv[++i];
+        if (0 == strcmp(name, loopBackendNames[LOOP_URING]))
+          backend = LOOP_URING;
+        else if (0 != strcmp(name, loopBackendNames[LOOP_EPOLL])) {
+          usage(argv[0]);
+          return 1;
+        }
+      }
+      else {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    if (opt.burst < 1 || opt.burst > 256 || opt.seconds <= 0) {
+      usage(argv[0]);
+      return 1;
+    }
+
+    if (coalesceHz > 0) {             // The default keymap, paced to frames
+      keymap *paced = new keymap;
+      paced->accel.coalesceNs = 1000000000ULL / coalesceHz;
+      paced->accel.coalesceFrames = true;
+      retireKeymap(swapKeymap(paced));
+    }
+
+    int slaveFd = -1;
+    if (openPty(gBench.masterFd, slaveFd) != 0)
+        exit(2);
+    output_sink sink;
+    if (sinkOpen(sink, opt.sink) != 0 || loopInit(gLoop, backend) < 0)
+        exit(4);
+    sinkAttach(sink, gLoop);
+
+    driverInit(gDriver, gLoop, -1, &sink, &gLatency);
+    if (threads && readerInit(gReader, gLoop, onBenchChunks, &gDriver) == 0) {
+        gDriver.reader = &gReader;
+        readerStart(gReader, slaveFd);
+    } else if (LOOP_URING == gLoop.backend) {
+        gDriver.serial = loopAddRead(gLoop, slaveFd, onBenchRead, &gDriver);
+    } else {
+        gDriver.serial = loopAdd(gLoop, slaveFd, EPOLLIN, onBenchSerial, &gDriver);
+    }
+    gBench.doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    gBench.drainFd = timerOpen();
+    loopAdd(gLoop, gBench.doneFd, EPOLLIN, onGeneratorDone, nullptr);
+    loopAdd(gLoop, gBench.drainFd, EPOLLIN, onDrained, nullptr);
+
+    printf("bench: %s pattern, %.0f bytes/s%s, %.1f s, %u byte writes, %s sink, %s%s\n", patternNames[opt.pattern],
+           opt.rate, opt.rate > 0 ? "" : " (unpaced)", opt.seconds, opt.burst, opt.sink,
+           loopBackendNames[gLoop.backend], gDriver.reader ? ", reader thread" : "");
+    gBench.startNs = monotonicNs();
+    std::thread writer(generator, std::ref(gBench));
+    const uint64_t syscallsBefore = benchSyscalls();
+    loopRun(gLoop);
+    const uint64_t syscalls = benchSyscalls() - syscallsBefore + gLoop.waits;
+    writer.join();
+
+    driverDestroy(gDriver);
+    readerDestroy(gReader);
+    loopDestroy(gLoop);
+
+    const uint64_t sent = gBench.sent.load();
+    const double seconds = (gBench.endNs - gBench.startNs) / 1e9;
+    driverPrintStats(gDriver);
+    latencyDump(gLatency, stdout);
+    printf("pty->emit (us)  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           latencyPercentile(gBench.transit, 0.50) / 1e3, latencyPercentile(gBench.transit, 0.90) / 1e3,
+           latencyPercentile(gBench.transit, 0.99) / 1e3, latencyPercentile(gBench.transit, 0.999) / 1e3,
+           gBench.transit.maxNs / 1e3);
+    printf("sent %llu bytes, received %llu, dropped %llu, unknown %llu\n",
+           (unsigned long long)sent, (unsigned long long)gDriver.stats.bytes,
+           (unsigned long long)(sent - gDriver.stats.bytes + gDriver.stats.overflow),
+           (unsigned long long)gDriver.stats.unknown);
+    printf("throughput: %.0f bytes/s, %.0f events/s, %llu input_events out\n",
+           gDriver.stats.bytes / seconds, gDriver.stats.events / seconds, (unsigned long long)sink.events);
+    printf("loop thread: %llu syscalls (%llu waits), %.2f per event\n", (unsigned long long)syscalls,
+           (unsigned long long)gLoop.waits, gDriver.stats.events ? (double)syscalls / gDriver.stats.events : 0.0);
+    if (LOOP_URING == gLoop.backend)
+        printf("io_uring: %llu writes queued (%llu more merged into them), %llu held back, %llu written directly, %llu failed\n",
+               (unsigned long long)gLoop.writesQueued, (unsigned long long)gLoop.writesMerged,
+               (unsigned long long)gLoop.writesDeferred, (unsigned long long)gLoop.writesDirect,
+               (unsigned long long)gLoop.writeErrors);
+
+    close(gBench.doneFd);
+    close(gBench.drainFd);
+    sinkClose(sink);
+    close(slaveFd);
+    close(gBench.masterFd);
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * @file click_state.h
+ * @brief Per-button double-click state machine for PINKIE, RING, SIDE and
+ *        TOP. The device reports a double click as the single click code
+ *        followed by a DBL_* code, so a single click is held back until
+ *        its timerfd deadline passes. The deadline lives in the event loop,
+ *        so the dial and knob keep flowing while a click is pending.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "event_loop.h"
+
+#define DBL_CLICK_WINDOW_NS 25000000L   // Give them about 25ms to double click
+
+enum click_phase : uint8_t {
+    CLICK_IDLE = 0,
+    CLICK_PENDING,     // single click seen, waiting for DBL_* or the deadline
+};
+
+struct click_tracker;
+
+struct click_button {
+    uint8_t single = 0;
+    uint8_t dbl = 0;
+    click_phase phase = CLICK_IDLE;
+    uint8_t layer = 0;          // Layer the held single click was pressed on
+    uint64_t sinceNs = 0;       // Read time of the held single click
+    int timerFd = -1;
+    loop_handler *handler = nullptr;
+    click_tracker *owner = nullptr;
+};
+
+// sinceNs is when the click's first byte was read, so the caller can see
+// how long it was held back; layer is the one it was pressed on.
+typedef void (*click_emit)(int key, uint8_t layer, uint64_t sinceNs, void *ctx);
+
+struct click_tracker {
+    std::array<click_button, 4> buttons = {{
+        {PINKIE, DBL_PINKIE}, {RING, DBL_RING}, {SIDE, DBL_SIDE}, {TOP, DBL_TOP}}};
+    long windowNs = DBL_CLICK_WINDOW_NS;
+    click_emit emit = nullptr;
+    void *ctx = nullptr;
+};
+
+// A button whose DBL_* code maps to nothing has no reason to wait.
+bool clickDoubleMapped(const action_table &actions, uint8_t dbl)
+{
+    const key_action &action = actions[dbl];
+    return ACTION_NONE != action.kind && KEY_RESERVED != action.code;
+}
+
+void onClickTimer(loop_handler &h, uint32_t /*events*/)
+{
+    click_button &b = *static_cast<click_button *>(h.ctx);
+    if (0 == timerAck(h.fd) || CLICK_PENDING != b.phase)
+        return;
+    b.phase = CLICK_IDLE;
+    b.owner->emit(b.single, b.layer, b.sinceNs, b.owner->ctx);   // No DBL_* in time, it was a single click
+}
+
+int clickInit(click_tracker &t, event_loop &loop, click_emit emit, void *ctx)
+{
+    t.emit = emit;
+    t.ctx = ctx;
+    for (auto &b : t.buttons) {
+        b.owner = &t;
+        b.timerFd = timerOpen();
+        if (b.timerFd < 0)
+            return -1;
+        b.handler = loopAdd(loop, b.timerFd, EPOLLIN, onClickTimer, &b);
+        if (nullptr == b.handler)
+            return -1;
+    }
+    return 0;
+}
+
+// Feeds one decoded press. Returns true if the code belongs to one of the
+// double-click buttons and has been taken care of (emitted now or held
+// back); false means the caller should handle it as usual. actions is the
+// table for `layer`, which the press was made on.
+bool clickFeed(click_tracker &t, uint8_t code, uint64_t nowNs, const action_table &actions, uint8_t layer)
+{
+    for (auto &b : t.buttons) {
+        if (code == b.dbl) {
+            uint64_t sinceNs = nowNs;
+            if (CLICK_PENDING == b.phase) {
+                timerDisarm(b.timerFd);
+                b.phase = CLICK_IDLE;
+                sinceNs = b.sinceNs;
+                layer = b.layer;
+            }
+            t.emit(b.dbl, layer, sinceNs, t.ctx);    // Double click returns a different code from device.
+            return true;
+        }
+        if (code != b.single)
+            continue;
+
+        if (b.timerFd < 0 || !clickDoubleMapped(actions, b.dbl)) {
+            t.emit(b.single, layer, nowNs, t.ctx);
+            return true;
+        }
+        if (CLICK_PENDING == b.phase)    // Second plain click: release the first
+            t.emit(b.single, b.layer, b.sinceNs, t.ctx);
+        b.phase = CLICK_PENDING;
+        b.layer = layer;
+        b.sinceNs = nowNs;
+        timerArm(b.timerFd, t.windowNs);
+        return true;
+    }
+    return false;
+}
+
+void clickDestroy(click_tracker &t, event_loop &loop)
+{
+    for (auto &b : t.buttons) {
+        if (b.timerFd < 0)
+            continue;
+        loopRemove(loop, b.handler);
+        b.handler = nullptr;
+        close(b.timerFd);
+        b.timerFd = -1;
+    }
+}
@@ -0,0 +1,159 @@
+/*
+ * @file coalesce.h
+ * @brief Optional merging of rotary detents, for consumers that redraw on
+ *        every step and fall behind a fast spin. Each control gets at most
+ *        one report per window (accel coalesce_ms) or per frame (accel
+ *        coalesce_hz, on a fixed monotonic grid). A detent that finds its
+ *        control idle still goes out at once, so slow turns gain no
+ *        latency; detents that arrive before the next slot are summed and
+ *        sent together when it opens. Nothing is dropped: the sum is exact,
+ *        and a reversal, another control's button or a shutdown sends what
+ *        is pending first, so the order of reports is kept.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "event_loop.h"
+#include "keymap.h"
+#include "rotary.h"
+#include "uinput_helper.h"
+
+// Detents of one control waiting for their slot.
+struct coalesce_slot {
+    key_action action;
+    uint8_t code = 0;             // Raw byte: a different one is a reversal
+    bool scroll = false;          // Hi-res wheel: detents, not whole steps
+    bool pending = false;
+    double amount = 0.0;          // Sum of steps, or of detents when scroll
+    uint64_t firstNs = 0;         // Read time of the oldest detent in it
+    uint64_t lastNs = 0;          // When this control last sent a report
+};
+
+struct rotary_coalescer {
+    std::array<coalesce_slot, ROTARY_COUNT> slots;
+    unsigned pending = 0;
+    uint64_t armedNs = 0;         // Timer deadline, 0 = disarmed
+    int timerFd = -1;
+    loop_handler *handler = nullptr;
+    event_batch *events = nullptr;
+    scroll_state *scroll = nullptr;
+    uint64_t detents = 0;
+    uint64_t reports = 0;
+};
+
+// When the slot after `lastNs` opens.
+uint64_t coalesceNextNs(const accel_curve &curve, uint64_t lastNs)
+{
+    if (curve.coalesceFrames)
+        return (lastNs / curve.coalesceNs + 1) * curve.coalesceNs;
+    return lastNs + curve.coalesceNs;
+}
+
+// Queues one report for everything in the slot, stamped with the oldest
+// detent's read time so read->emit shows what merging cost.
+void coalesceEmit(rotary_coalescer &c, coalesce_slot &slot, uint64_t nowNs)
+{
+    event_batch &events = *c.events;
+    const uint64_t stampNs = events.stampNs;
+    events.stampNs = slot.firstNs;
+    if (slot.scroll)
+        generateScrollEvent(events, *c.scroll, slot.action, slot.amount);
+    else
+        generateRotaryEvent(events, slot.action, (int)slot.amount);
+    events.stampNs = stampNs;
+    if (slot.pending)
+        c.pending--;
+    slot.pending = false;
+    slot.amount = 0.0;
+    slot.lastNs = nowNs;
+    c.reports++;
+}
+
+// Sends everything waiting. The caller flushes the batch.
+void coalesceFlush(rotary_coalescer &c)
+{
+    if (0 == c.pending)
+        return;
+    const uint64_t nowNs = monotonicNs();
+    for (auto &slot : c.slots)
+        if (slot.pending)
+            coalesceEmit(c, slot, nowNs);
+}
+
+void onCoalesceTimer(loop_handler &h, uint32_t /*events*/)
+{
+    rotary_coalescer &c = *static_cast<rotary_coalescer *>(h.ctx);
+    if (0 == timerAck(h.fd))
+        return;
+    c.armedNs = 0;
+    coalesceFlush(c);
+    flushEvents(*c.events);
+}
+
+// One detent worth `amount` steps (or detents, for a hi-res scroll).
+void coalesceRotary(rotary_coalescer &c, const accel_curve &curve, uint8_t code, const key_action &action,
+                    bool scroll, double amount, uint64_t readNs)
+{
+    rotary_control control;
+    int8_t direction;
+    if (!rotaryControl(code, control, direction))
+        return;
+    coalesce_slot &slot = c.slots[control];
+    if (0.0 == amount)                          // Precision mode carried it all over
+        return;
+    const uint64_t nowNs = monotonicNs();
+    c.detents++;
+    if (slot.pending && slot.code != code)      // Reversed: the old way goes first
+        coalesceEmit(c, slot, nowNs);
+    slot.action = action;
+    slot.code = code;
+    slot.scroll = scroll;
+    slot.amount += amount;
+    if (0 == curve.coalesceNs || c.timerFd < 0
+     || (!slot.pending && nowNs >= coalesceNextNs(curve, slot.lastNs))) {
+        slot.firstNs = readNs;
+        coalesceEmit(c, slot, nowNs);           // Idle control: no reason to wait
+        return;
+    }
+    if (slot.pending)
+        return;
+    slot.pending = true;
+    slot.firstNs = readNs;
+    c.pending++;
+    const uint64_t dueNs = coalesceNextNs(curve, slot.lastNs);
+    if (0 == c.armedNs || dueNs < c.armedNs) {
+        c.armedNs = dueNs;
+        timerArm(c.timerFd, (dueNs > nowNs) ? dueNs - nowNs : 1);
+    }
+}
+
+int coalesceInit(rotary_coalescer &c, event_loop &loop, event_batch *events, scroll_state *scroll)
+{
+    c.events = events;
+    c.scroll = scroll;
+    c.timerFd = timerOpen();
+    if (c.timerFd < 0)
+        return -1;
+    c.handler = loopAdd(loop, c.timerFd, EPOLLIN, onCoalesceTimer, &c);
+    if (c.handler == nullptr) {
+        close(c.timerFd);
+        c.timerFd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void coalesceDestroy(rotary_coalescer &c, event_loop &loop)
+{
+    loopRemove(loop, c.handler);
+    c.handler = nullptr;
+    if (c.timerFd >= 0)
+        close(c.timerFd);
+    c.timerFd = -1;
+}
@@ -0,0 +1,281 @@
+/*
+ * @file config_cache.h
+ * @brief Precompiled binary image of the parsed config. The first start
+ *        after tourbox.conf changes runs the full libconfuse parse and
+ *        writes the resulting keymap out as a versioned, checksummed
+ *        image keyed on the source's mtime, size and content hash. Later
+ *        starts mmap the image and copy the tables straight out of it.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "keymap.h"
+
+#define KEYMAP_CACHE_MAGIC   0x50414d4b58425400ULL   // "\0TBXKMAP"
+#define KEYMAP_CACHE_VERSION 6                       // Bump with any layout change
+#define KEYMAP_CACHE_TTY     64
+
+struct keymap_cache_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t actionSize;      // sizeof(key_action) and sizeof(accel_curve) the
+    uint32_t accelSize;       // image was written with, in case a build changes them
+    uint32_t execCount;
+    uint32_t macroCount;      // macro_steps after the layers
+    uint32_t stepSize;
+    uint32_t layerCount;      // action_tables right after the body
+    uint32_t deviceCount;     // name, tty, profile string triples after the execs
+    uint64_t payloadSize;
+    uint64_t payloadHash;     // FNV-1a of everything after the header
+    int64_t srcMtimeNs;
+    uint64_t srcSize;
+    uint64_t srcHash;         // FNV-1a of tourbox.conf itself
+};
+
+// Fixed part of the payload. The layer tables follow, then the macro
+// steps, then the exec strings and the device sections as NUL-terminated
+// runs.
+struct keymap_cache_body {
+    action_table actions;
+    accel_curve accel;
+    serial_options serial;
+    uint8_t hiresScroll;
+    char tty[KEYMAP_CACHE_TTY];
+};
+
+uint64_t fnv1a(const void *data, size_t len, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// $XDG_CACHE_HOME/tourbox-keymap-<hash>.bin, or ~/.cache/..., or "" if
+// neither is set. The hash is of the config's full path, so each profile
+// keeps its own image instead of evicting the others'.
+std::string cachePath(const char *filename)
+{
+    char full[PATH_MAX];
+    const char *key = (realpath(filename, full) != nullptr) ? full : filename;
+    char name[48];
+    snprintf(name, sizeof(name), "/tourbox-keymap-%016llx.bin", (unsigned long long)fnv1a(key, strlen(key)));
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    if (xdg != nullptr && xdg[0] != '\0')
+        return std::string(xdg) + name;
+    const char *home = getenv("HOME");
+    if (home != nullptr && home[0] != '\0')
+        return std::string(home) + "/.cache" + name;
+    return "";
+}
+
+// Next NUL-terminated string of the payload, or "" past the end.
+std::string cacheString(const char *&p, const char *end)
+{
+    if (p >= end)
+        return "";
+    const size_t len = strnlen(p, end - p);
+    std::string str(p, len);
+    p += len + 1;
+    return str;
+}
+
+// Identity of the source file. All three must match the image; the hash
+// catches edits that keep the mtime (cp -p, tar, clock skew).
+bool sourceKey(const char *filename, int64_t &mtimeNs, uint64_t &size, uint64_t &hash)
+{
+    const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    size = st.st_size;
+    hash = fnv1a(nullptr, 0);
+
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        hash = fnv1a(buf, n, hash);
+    close(fd);
+    return n == 0;
+}
+
+// Every exec and macro an action names has to exist: an image written by
+// another build can hash fine and still point past the tables.
+bool cacheIndicesValid(const keymap &map)
+{
+    if (!map.macroSteps.empty() && MACRO_END != map.macroSteps.back().op)
+        return false;            // macroStart() copies up to the next end
+    auto valid = [&map](const action_table &table) {
+        for (const key_action &a : table)
+            if (a.exec > map.execs.size() || a.macro > map.macroSteps.size())
+                return false;
+        return true;
+    };
+    if (!valid(map.actions))
+        return false;
+    for (const action_table &layer : map.layers)
+        if (!valid(layer))
+            return false;
+    return true;
+}
+
+// Fills map and tty from a valid, current image. Returns false (and leaves
+// map alone) for a missing, stale, truncated or corrupt one.
+bool loadCache(const char *filename, keymap &map, std::string &tty)
+{
+    int64_t mtimeNs;
+    uint64_t size, hash;
+    const std::string path = cachePath(filename);
+    if (path.empty() || !sourceKey(filename, mtimeNs, size, hash))
+        return false;
+
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(keymap_cache_header) + sizeof(keymap_cache_body)) {
+        close(fd);
+        return false;
+    }
+    void *image = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == image)
+        return false;
+
+    const auto *header = static_cast<const keymap_cache_header *>(image);
+    const char *payload = static_cast<const char *>(image) + sizeof(*header);
+    bool valid = KEYMAP_CACHE_MAGIC == header->magic
+              && KEYMAP_CACHE_VERSION == header->version
+              && sizeof(key_action) == header->actionSize
+              && sizeof(accel_curve) == header->accelSize
+              && sizeof(macro_step) == header->stepSize
+              && header->layerCount < KEYMAP_MAX_LAYERS
+              && header->deviceCount <= KEYMAP_MAX_DEVICES
+              && header->payloadSize >= sizeof(keymap_cache_body) + header->layerCount * sizeof(action_table)
+                                        + header->macroCount * sizeof(macro_step)
+              && header->payloadSize == st.st_size - sizeof(*header)
+              && header->srcMtimeNs == mtimeNs
+              && header->srcSize == size
+              && header->srcHash == hash
+              && header->payloadHash == fnv1a(payload, header->payloadSize);
+    if (valid) {
+        const auto *body = reinterpret_cast<const keymap_cache_body *>(payload);
+        keymap loaded = map;
+        loaded.actions = body->actions;
+        loaded.accel = body->accel;
+        loaded.serial = body->serial;
+        loaded.hiresScroll = body->hiresScroll;
+
+        const action_table *layers = reinterpret_cast<const action_table *>(payload + sizeof(*body));
+        loaded.layers.assign(layers, layers + header->layerCount);
+        const macro_step *steps = reinterpret_cast<const macro_step *>(layers + header->layerCount);
+        loaded.macroSteps.assign(steps, steps + header->macroCount);
+
+        loaded.execs.clear();
+        const char *p = reinterpret_cast<const char *>(steps + header->macroCount);
+        const char *end = payload + header->payloadSize;
+        for (uint32_t i = 0; i < header->execCount && p < end; i++)
+            loaded.execs.push_back(cacheString(p, end));
+        loaded.devices.clear();
+        for (uint32_t i = 0; i < header->deviceCount && p < end; i++) {
+            device_config dev;
+            dev.name = cacheString(p, end);
+            dev.tty = cacheString(p, end);
+            dev.profile = cacheString(p, end);
+            loaded.devices.push_back(dev);
+        }
+        valid = cacheIndicesValid(loaded);   // A hash only proves the file is whole
+        if (valid) {
+            map = std::move(loaded);
+            tty.assign(body->tty, strnlen(body->tty, sizeof(body->tty)));
+        }
+    }
+    munmap(image, st.st_size);
+    return valid;
+}
+
+// Writes a fresh image next to the old one and renames it into place, so a
+// concurrent reader only ever sees a whole image.
+bool storeCache(const char *filename, const keymap &map, const std::string &tty)
+{
+    keymap_cache_header header = {};
+    const std::string path = cachePath(filename);
+    if (path.empty() || tty.size() >= KEYMAP_CACHE_TTY
+     || !sourceKey(filename, header.srcMtimeNs, header.srcSize, header.srcHash))
+        return false;
+
+    std::string payload(sizeof(keymap_cache_body), '\0');
+    keymap_cache_body *body = reinterpret_cast<keymap_cache_body *>(payload.data());
+    body->actions = map.actions;
+    body->accel = map.accel;
+    body->serial = map.serial;
+    body->hiresScroll = map.hiresScroll;
+    memcpy(body->tty, tty.c_str(), tty.size() + 1);
+    payload.append(reinterpret_cast<const char *>(map.layers.data()), map.layers.size() * sizeof(action_table));
+    payload.append(reinterpret_cast<const char *>(map.macroSteps.data()), map.macroSteps.size() * sizeof(macro_step));
+    for (const auto &exec : map.execs)
+        payload.append(exec.c_str(), exec.size() + 1);
+    for (const auto &dev : map.devices)
+        for (const std::string *str : {&dev.name, &dev.tty, &dev.profile})
+            payload.append(str->c_str(), str->size() + 1);
+
+    header.magic = KEYMAP_CACHE_MAGIC;
+    header.version = KEYMAP_CACHE_VERSION;
+    header.actionSize = sizeof(key_action);
+    header.accelSize = sizeof(accel_curve);
+    header.execCount = map.execs.size();
+    header.macroCount = map.macroSteps.size();
+    header.stepSize = sizeof(macro_step);
+    header.layerCount = map.layers.size();
+    header.deviceCount = map.devices.size();
+    header.payloadSize = payload.size();
+    header.payloadHash = fnv1a(payload.data(), payload.size());
+
+    // Per-thread name: a reload and a profile switch may write at once
+    const std::string tmp = path + ".tmp." + std::to_string(gettid());
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+    const bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+                 && fwrite(payload.data(), payload.size(), 1, f) == 1;
+    if (fclose(f) != 0 || !ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// What startup and reloads call: the image if it is current, otherwise a
+// full parse that refreshes the image. Returns the tty like parse_conf().
+std::string loadConfig(const char *filename, keymap &map)
+{
+    std::string tty;
+    if (loadCache(filename, map, tty))
+        return tty;
+    tty = parse_conf(filename, map);
+    if ("0" != tty && !storeCache(filename, map, tty)) {
+        D(printf("note: could not write keymap cache %s\n", cachePath(filename).c_str());)
+    }
+    return tty;
+}
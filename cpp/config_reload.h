@@ -0,0 +1,158 @@
+/*
+ * @file config_reload.h
+ * @brief Live reload of tourbox.conf. An inotify watch on the config's
+ *        directory notices the file being rewritten (or replaced by an
+ *        editor's rename), a worker thread parses it into a fresh keymap
+ *        off the event path, and the loop thread publishes it with a
+ *        single atomic pointer swap. The virtual device is untouched, so
+ *        there is no input gap.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+#include "event_loop.h"
+#include "keymap.h"
+#include "config_cache.h"
+
+struct config_reloader {
+    std::string path;
+    std::string dir;
+    std::string name;
+    keymap_slot *slot = &activeKeymap;        // The profile this file feeds
+    int inotifyFd = -1;
+    int readyFd = -1;                         // eventfd: worker -> loop
+    std::thread worker;                       // The last one started, joined before the next
+    std::atomic<keymap *> pending{nullptr};   // Parsed, not yet published
+    std::atomic<bool> busy{false};
+    std::atomic<bool> again{false};           // Changed again while parsing
+    uint64_t reloads = 0;
+    std::atomic<uint64_t> failures{0};
+};
+
+// Runs on its own thread. Parses until the file stops changing under it,
+// then leaves the newest table in `pending` and pokes the loop.
+void reloadWorker(config_reloader *r)
+{
+    for (;;) {
+        do {
+            r->again.store(false);
+            keymap *fresh = new keymap;
+            if ("0" == loadConfig(r->path.c_str(), *fresh)) {
+                delete fresh;     // Keep serving the old table
+                r->failures++;
+                continue;
+            }
+            delete r->pending.exchange(fresh);
+            const uint64_t one = 1;
+            if (write(r->readyFd, &one, sizeof(one)) != sizeof(one))
+                perror("config reload: eventfd");
+        } while (r->again.load());
+
+        r->busy.store(false);
+        // A change that landed between the last check and clearing busy
+        // found us still busy; pick it up unless a new worker already has.
+        if (!r->again.load() || r->busy.exchange(true))
+            break;
+    }
+}
+
+// Starts a parse of the config, or has the one running go round again.
+// Loop thread only.
+void reloadKick(config_reloader &r)
+{
+    if (r.busy.exchange(true)) {
+        r.again.store(true);   // The running worker will go round once more
+        return;
+    }
+    if (r.worker.joinable())   // Cleared busy, so it is done or about to be
+        r.worker.join();
+    r.worker = std::thread(reloadWorker, &r);
+}
+
+void onConfigChanged(loop_handler &h, uint32_t /*events*/)
+{
+    config_reloader &r = *static_cast<config_reloader *>(h.ctx);
+    alignas(struct inotify_event) char buf[4096];
+    bool ours = false;
+
+    ssize_t n;
+    while ((n = read(h.fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = reinterpret_cast<const struct inotify_event *>(p);
+            if (ev->len > 0 && r.name == ev->name)
+                ours = true;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    if (ours)
+        reloadKick(r);
+}
+
+// The loop thread is the only reader of the table, so it can retire the
+// old one as soon as the new one is in place.
+void onConfigReady(loop_handler &h, uint32_t /*events*/)
+{
+    config_reloader &r = *static_cast<config_reloader *>(h.ctx);
+    uint64_t count;
+    if (read(h.fd, &count, sizeof(count)) != sizeof(count))
+        return;
+
+    keymap *fresh = r.pending.exchange(nullptr);
+    if (fresh == nullptr)
+        return;
+    fresh->hiresScroll = currentKeymap(*r.slot).hiresScroll;   // Fixed when the device was created
+    retireKeymap(swapKeymap(fresh, *r.slot));
+    r.reloads++;
+    printf("%s reloaded\n", r.path.c_str());
+}
+
+int reloadInit(config_reloader &r, event_loop &loop, const char *path, keymap_slot &slot = activeKeymap)
+{
+    r.path = path;
+    r.slot = &slot;
+    const size_t slash = r.path.rfind('/');
+    r.dir = (slash == std::string::npos) ? "." : r.path.substr(0, slash);
+    r.name = (slash == std::string::npos) ? r.path : r.path.substr(slash + 1);
+
+    // Watch the directory, not the file: editors often write a new file and
+    // rename it over the old one, which would orphan a watch on the inode.
+    r.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (r.inotifyFd < 0 || inotify_add_watch(r.inotifyFd, r.dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        perror("inotify");
+        return -1;
+    }
+    r.readyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r.readyFd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+    if (loopAdd(loop, r.inotifyFd, EPOLLIN, onConfigChanged, &r) == nullptr
+     || loopAdd(loop, r.readyFd, EPOLLIN, onConfigReady, &r) == nullptr)
+        return -1;
+    return 0;
+}
+
+// Waits out a reload still parsing, so nothing is left touching `r`.
+void reloadDestroy(config_reloader &r)
+{
+    if (r.worker.joinable())
+        r.worker.join();
+    delete r.pending.exchange(nullptr);
+    if (r.inotifyFd >= 0)
+        close(r.inotifyFd);
+    if (r.readyFd >= 0)
+        close(r.readyFd);
+    r.inotifyFd = r.readyFd = -1;
+}
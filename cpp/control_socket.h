@@ -0,0 +1,353 @@
+/*
+ * @file control_socket.h
+ * @brief Runtime control over a Unix stream socket, one command per line:
+ *
+ *          stats                     counters and latency percentiles
+ *          reload                    re-read the config file
+ *          profile PATH              switch to another config file
+ *          bind BUTTON KEY [LAYER]   send KEY for BUTTON, e.g. bind MOON KEY_F5
+ *          layer N                   toggle layer N on (0 = base)
+ *
+ *        A thread of its own accepts clients, reads and parses lines and
+ *        parses whole profiles, then hands finished requests to the event
+ *        loop through a lock-free queue and an eventfd. The loop applies
+ *        them between input events and queues the reply back the same
+ *        way, so no socket I/O or parsing ever runs on the input path.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include "event_loop.h"
+#include "keymap.h"
+#include "config_cache.h"
+#include "spsc_queue.h"
+
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_LINE_MAX    256   // Longer lines are refused whole
+#define CONTROL_REPLY_MAX   1024
+
+enum control_kind : uint8_t {
+    CONTROL_STATS = 0,
+    CONTROL_RELOAD,
+    CONTROL_KEYMAP,      // A profile, already parsed into `map`
+    CONTROL_BIND,
+    CONTROL_LAYER,
+};
+
+struct control_request {
+    control_kind kind = CONTROL_STATS;
+    uint8_t client = 0;        // Slot and generation the reply goes back to
+    uint32_t generation = 0;
+    uint8_t button = 0;        // BIND: raw TourBox code
+    uint8_t layer = 0;         // BIND, LAYER
+    uint16_t code = 0;         // BIND: EV_KEY code
+    keymap *map = nullptr;     // KEYMAP: owned by whoever pops it
+    char path[CONTROL_LINE_MAX] = "";   // KEYMAP: the file it came from
+};
+
+struct control_reply {
+    uint8_t client = 0;
+    uint32_t generation = 0;
+    char text[CONTROL_REPLY_MAX];
+};
+
+// Runs on the loop thread for each request; fills reply.text.
+typedef void (*control_apply)(const control_request &req, control_reply &reply, void *ctx);
+
+struct control_client {
+    int fd = -1;
+    uint32_t generation = 0;
+    std::string line;
+    bool overlong = false;     // Dropping the rest of a line past CONTROL_LINE_MAX
+};
+
+struct control_server {
+    std::string path;
+    int listenFd = -1;
+    int loopWakeFd = -1;       // eventfd: requests are waiting for the loop
+    int threadWakeFd = -1;     // eventfd: replies are waiting, or stop
+    std::atomic<bool> stop{false};
+    std::thread thread;
+    spsc_queue<control_request, 64> requests;   // control thread -> loop
+    spsc_queue<control_reply, 16> replies;      // loop -> control thread
+    std::array<control_client, CONTROL_MAX_CLIENTS> clients;
+    control_apply apply = nullptr;
+    void *ctx = nullptr;
+    event_loop *loop = nullptr;
+    loop_handler *handler = nullptr;
+    std::bitset<KEY_CNT> keys; // What the virtual devices advertised, set before controlStart()
+    uint64_t commands = 0;
+};
+
+// $XDG_RUNTIME_DIR/tourbox.sock, or /tmp/tourbox-UID.sock without one.
+std::string controlPath(void)
+{
+    const char *run = getenv("XDG_RUNTIME_DIR");
+    if (run != nullptr && run[0] != '\0')
+        return std::string(run) + "/tourbox.sock";
+    return "/tmp/tourbox-" + std::to_string(getuid()) + ".sock";
+}
+
+void controlWrite(control_client &c, const char *text)
+{
+    if (c.fd >= 0 && send(c.fd, text, strlen(text), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+        D(perror("control: reply");)
+}
+
+void controlPost(control_server &s, const control_request &req)
+{
+    const uint64_t one = 1;
+    if (!spscPush(s.requests, req)) {
+        delete req.map;
+        controlWrite(s.clients[req.client], "error busy\n");
+        return;
+    }
+    if (write(s.loopWakeFd, &one, sizeof(one)) != sizeof(one))
+        perror("control: eventfd");
+}
+
+// Parses one line on the control thread. Profiles are parsed here too,
+// the loop only ever gets a finished keymap.
+void controlCommand(control_server &s, uint8_t slot, const std::string &line)
+{
+    control_client &c = s.clients[slot];
+    char verb[32] = "", arg1[CONTROL_LINE_MAX] = "", arg2[64] = "";
+    unsigned layer = 0;
+    const int n = sscanf(line.c_str(), "%31s %255s %63s %u", verb, arg1, arg2, &layer);
+    control_request req;
+    req.client = slot;
+    req.generation = c.generation;
+
+    if (n < 1)
+        return;
+    if (0 == strcmp(verb, "stats"))
+        req.kind = CONTROL_STATS;
+    else if (0 == strcmp(verb, "reload"))
+        req.kind = CONTROL_RELOAD;
+    else if (0 == strcmp(verb, "profile") && n >= 2) {
+        req.kind = CONTROL_KEYMAP;
+        req.map = new keymap;
+        if ("0" == loadConfig(arg1, *req.map)) {
+            delete req.map;
+            controlWrite(c, "error cannot load profile\n");
+            return;
+        }
+        snprintf(req.path, sizeof(req.path), "%s", arg1);
+    }
+    else if (0 == strcmp(verb, "bind") && n >= 3) {
+        req.kind = CONTROL_BIND;
+        req.button = codeByName(arg1);
+        req.code = keyCodeByName(arg2);
+        req.layer = layer;
+        if (0 == req.button || 0 == req.code || layer >= KEYMAP_MAX_LAYERS) {
+            controlWrite(c, "error usage: bind BUTTON KEY [LAYER]\n");
+            return;
+        }
+        if (!s.keys.test(req.code)) {   // The kernel would drop it without a word
+            controlWrite(c, "error the virtual device cannot send that key, use a KEY_ name\n");
+            return;
+        }
+    }
+    else if (0 == strcmp(verb, "layer") && n >= 2) {
+        req.kind = CONTROL_LAYER;
+        req.layer = atoi(arg1);
+        if (req.layer >= KEYMAP_MAX_LAYERS) {
+            controlWrite(c, "error no such layer\n");
+            return;
+        }
+    }
+    else {
+        controlWrite(c, "error commands: stats, reload, profile PATH, bind BUTTON KEY [LAYER], layer N\n");
+        return;
+    }
+    controlPost(s, req);
+}
+
+void controlRead(control_server &s, uint8_t slot)
+{
+    control_client &c = s.clients[slot];
+    char buf[512];
+    const ssize_t n = recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n < 0 && (EAGAIN == errno || EINTR == errno))
+        return;
+    if (n <= 0) {
+        close(c.fd);
+        c.fd = -1;
+        c.line.clear();
+        c.overlong = false;
+        return;
+    }
+    for (ssize_t i = 0; i < n; i++) {
+        if ('\n' != buf[i]) {
+            if (c.line.size() < CONTROL_LINE_MAX)
+                c.line += buf[i];
+            else
+                c.overlong = true;
+            continue;
+        }
+        if (!c.line.empty() && '\r' == c.line.back())
+            c.line.pop_back();
+        if (c.overlong)                 // Never run what is left of a cut line
+            controlWrite(c, "error line too long\n");
+        else
+            controlCommand(s, slot, c.line);
+        c.line.clear();
+        c.overlong = false;
+    }
+}
+
+void controlThread(control_server *s)
+{
+    for (;;) {
+        struct pollfd fds[2 + CONTROL_MAX_CLIENTS];
+        fds[0] = {s->listenFd, POLLIN, 0};
+        fds[1] = {s->threadWakeFd, POLLIN, 0};
+        for (unsigned i = 0; i < CONTROL_MAX_CLIENTS; i++)
+            fds[2 + i] = {s->clients[i].fd, POLLIN, 0};   // -1 is skipped by poll()
+        if (poll(fds, 2 + CONTROL_MAX_CLIENTS, -1) < 0 && EINTR != errno)
+            break;
+        if (s->stop.load())
+            break;
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            if (read(s->threadWakeFd, &count, sizeof(count)) != sizeof(count))
+                continue;
+            control_reply reply;
+            while (spscPop(s->replies, reply))
+                if (s->clients[reply.client].generation == reply.generation)   // Still the same client
+                    controlWrite(s->clients[reply.client], reply.text);
+        }
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept4(s->listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            unsigned i = 0;
+            while (i < CONTROL_MAX_CLIENTS && s->clients[i].fd >= 0)
+                i++;
+            if (fd >= 0 && i == CONTROL_MAX_CLIENTS) {
+                send(fd, "error too many clients\n", 23, MSG_NOSIGNAL);
+                close(fd);
+            } else if (fd >= 0) {
+                s->clients[i].fd = fd;
+                s->clients[i].generation++;
+            }
+        }
+        for (unsigned i = 0; i < CONTROL_MAX_CLIENTS; i++)
+            if (fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR))
+                controlRead(*s, i);
+    }
+}
+
+// Loop side: applies what the control thread queued and queues replies.
+void onControlRequest(loop_handler &h, uint32_t /*events*/)
+{
+    control_server &s = *static_cast<control_server *>(h.ctx);
+    uint64_t count;
+    if (read(h.fd, &count, sizeof(count)) != sizeof(count))
+        return;
+    control_request req;
+    bool replied = false;
+    while (spscPop(s.requests, req)) {
+        control_reply reply;
+        reply.client = req.client;
+        reply.generation = req.generation;
+        snprintf(reply.text, sizeof(reply.text), "ok\n");
+        s.apply(req, reply, s.ctx);
+        s.commands++;
+        replied |= spscPush(s.replies, reply);   // A client too slow to read loses it
+    }
+    const uint64_t one = 1;
+    if (replied && write(s.threadWakeFd, &one, sizeof(one)) != sizeof(one))
+        perror("control: eventfd");
+}
+
+int controlStart(control_server &s, event_loop &loop, const std::string &path, control_apply apply, void *ctx)
+{
+    s.path = path;
+    s.apply = apply;
+    s.ctx = ctx;
+    s.loop = &loop;
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return -1;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    s.listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s.listenFd < 0)
+        return -1;
+    if (connect(s.listenFd, (struct sockaddr *)&addr, sizeof(addr)) == 0 || EAGAIN == errno) {
+        fprintf(stderr, "%s: another driver is already listening\n", path.c_str());
+        close(s.listenFd);
+        s.listenFd = -1;
+        s.path.clear();           // Not ours to unlink
+        return -1;
+    }
+    close(s.listenFd);
+    s.listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path.c_str());         // Left over from a daemon that did not exit cleanly
+    if (s.listenFd < 0 || bind(s.listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+     || listen(s.listenFd, 4) != 0) {
+        perror(path.c_str());
+        return -1;
+    }
+    chmod(path.c_str(), 0600);    // Rebinding keys is the user's business only
+    s.loopWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s.threadWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s.loopWakeFd < 0 || s.threadWakeFd < 0) {
+        perror("control: eventfd");
+        return -1;
+    }
+    s.handler = loopAdd(loop, s.loopWakeFd, EPOLLIN, onControlRequest, &s);
+    if (s.handler == nullptr)
+        return -1;
+    s.thread = std::thread(controlThread, &s);
+    return 0;
+}
+
+void controlStop(control_server &s)
+{
+    if (s.thread.joinable()) {
+        s.stop.store(true);
+        const uint64_t one = 1;
+        if (write(s.threadWakeFd, &one, sizeof(one)) != sizeof(one))
+            perror("control: eventfd");
+        s.thread.join();
+    }
+    if (s.loop != nullptr)
+        loopRemove(*s.loop, s.handler);
+    s.handler = nullptr;
+    control_request req;
+    while (spscPop(s.requests, req))
+        delete req.map;
+    for (auto &c : s.clients)
+        if (c.fd >= 0) {
+            close(c.fd);
+            c.fd = -1;
+        }
+    for (int *fd : {&s.listenFd, &s.loopWakeFd, &s.threadWakeFd})
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    if (!s.path.empty())
+        unlink(s.path.c_str());
+}
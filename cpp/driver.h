@@ -0,0 +1,318 @@
+/*
+ * @file driver.h
+ * @brief The per-device input pipeline: serial bytes in, ring buffer,
+ *        decoder, double-click tracking, rotary acceleration, keymap and
+ *        the event batch out to a sink. Everything a TourBox needs lives
+ *        in one tourbox_driver, so the daemon and the benchmark harness
+ *        run the exact same path. The tty is read either by the loop
+ *        itself or, with a serial_reader, by a thread of its own.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include "uinput_helper.h"
+#include "event_loop.h"
+#include "serial_decoder.h"
+#include "click_state.h"
+#include "rotary.h"
+#include "latency.h"
+#include "trace.h"
+#include "exec_spawner.h"
+#include "macro.h"
+#include "layers.h"
+#include "coalesce.h"
+#include "serial_reader.h"
+
+struct tourbox_driver;
+typedef void (*driver_lost)(tourbox_driver &d, void *ctx);
+
+struct tourbox_driver {
+    event_loop *loop = nullptr;
+    loop_handler *serial = nullptr;
+    serial_reader *reader = nullptr;   // Reads the tty on its own thread, if there is one
+    byte_ring ring;
+    decoder_stats stats;
+    click_tracker clicks;
+    key_state keys;
+    layer_state layers;
+    rotary_engine rotary;
+    scroll_state scroll;
+    rotary_coalescer coalesce;         // Optional: fewer, bigger rotary reports
+    event_batch events;
+    uint64_t readNs = 0;               // When the bytes being decoded were read
+    latency_stats *latency = nullptr;
+    trace_file *record = nullptr;      // --record: raw bytes as they are read
+    exec_spawner *spawner = nullptr;   // Runs exec actions, if there is one
+    macro_engine macros;               // Waits go on the loop's timer wheel
+    keymap_slot *profile = &activeKeymap;   // Shared by every device on the same profile
+    driver_lost lost = nullptr;        // The tty went away; without this the loop stops
+    void *lostCtx = nullptr;
+};
+
+// A tap, whether straight from the decoder or after the double click
+// window. A macro or exec action replaces the key's own report.
+void driverTap(tourbox_driver &d, const keymap &keys, const key_action &action)
+{
+    if (action.macro) {
+      if (!macroStart(d.macros, keys, action.macro))
+        std::cerr << "macro for " << keyfig[action.figure].tstr << " dropped" << std::endl;
+      return;
+    }
+    if (0 == action.exec) {
+      generateKeyPressEvent(d.events, action);
+      return;
+    }
+    if (d.spawner == nullptr || !spawnerRun(*d.spawner, keys.execs[action.exec - 1]))
+      std::cerr << "exec for " << keyfig[action.figure].tstr << " dropped" << std::endl;
+}
+
+void driverMap(tourbox_driver &d, uint8_t code, byte_kind kind)
+{
+    const keymap &keys = currentKeymap(*d.profile);   // Stable for this event: only the
+    const accel_curve &accel = keys.accel;  // loop thread swaps tables
+    if (code == accel.precisionKey) {               // Precision modifier only
+      d.keys.held.set(code, BYTE_PRESS == kind);    // changes the rotary gain
+      return;
+    }
+    if (!isRotary(code))            // Rotary steps still waiting go out first
+      coalesceFlush(d.coalesce);
+    const uint8_t layer = d.layers.active;
+    const key_action &action = layerTable(keys, layer)[code];
+    if (ACTION_LAYER == action.kind) {      // Every layer shares the modifiers
+      layerModifier(d.layers, action, BYTE_PRESS == kind);
+      return;
+    }
+    if (BYTE_RELEASE == kind) {     // End of a detent or a tap: nothing to send,
+      if (d.keys.held.test(code))   // unless a hold is down, on whatever layer
+        generateKeyHoldEvent(d.events, d.keys, code, action, false);
+      return;
+    }
+    layerConsume(d.layers);         // A one-shot layer covers this press only
+    if ((action.flags & ACTION_HOLD) && !isScripted(action)) {   // Real down/up, so holds,
+      generateKeyHoldEvent(d.events, d.keys, code, action, true); // drags and modifiers work
+      return;
+    }
+    if (isRotary(code) && !isScripted(action)) {
+      const bool precise = accel.precisionKey && d.keys.held.test(accel.precisionKey);
+      const bool scroll = keys.hiresScroll && ACTION_WHEEL == action.kind;
+      const double amount = scroll ? rotaryAdvance(d.rotary, accel, code, d.readNs, precise)
+                                   : rotaryStep(d.rotary, accel, code, d.readNs, precise);
+      coalesceRotary(d.coalesce, accel, code, action, scroll, amount, d.readNs);
+      return;
+    }
+    if (clickFeed(d.clicks, code, d.readNs, layerTable(keys, layer), layer))   // PINKIE, RING, SIDE
+      return;                                         // and TOP wait on a timerfd for a double click.
+    driverTap(d, keys, action);
+}
+
+// Called by the decoder for every press and release.
+void driverDecoded(uint8_t code, byte_kind kind, void *ctx)
+{
+    tourbox_driver &d = *static_cast<tourbox_driver *>(ctx);
+    const uint64_t decodedNs = monotonicNs();
+    latencyRecord(*d.latency, STAGE_DECODE, decodedNs - d.readNs);
+    d.events.stampNs = d.readNs;
+    driverMap(d, code, kind);
+    latencyRecord(*d.latency, STAGE_MAP, monotonicNs() - decodedNs);
+}
+
+// A click can come from a timer deadline rather than from a read, so its
+// report goes out right away.
+void driverClick(int key, uint8_t layer, uint64_t sinceNs, void *ctx)
+{
+    tourbox_driver &d = *static_cast<tourbox_driver *>(ctx);
+    const uint64_t nowNs = monotonicNs();
+    latencyRecord(*d.latency, STAGE_HOLD, nowNs - sinceNs);
+    d.events.stampNs = sinceNs;
+    coalesceFlush(d.coalesce);
+    const keymap &keys = currentKeymap(*d.profile);
+    driverTap(d, keys, layerTable(keys, layer)[key & 0xff]);
+    latencyRecord(*d.latency, STAGE_MAP, monotonicNs() - nowNs);
+    flushEvents(d.events);
+}
+
+// Lets go of everything the device had down, as its releases will never
+// arrive: running macros, hold keys and hold layers. The releases are
+// written out before this returns.
+void driverRelease(tourbox_driver &d)
+{
+    d.events.stampNs = 0;
+    coalesceFlush(d.coalesce);  // Keeps the final position exact
+    macroCancelAll(d.macros);
+    for (unsigned code = 0; code < d.keys.held.size(); code++)
+      if (d.keys.held.test(code) && d.keys.sent[code]) {   // The precision key sent nothing
+        emit(d.events, EV_KEY, d.keys.sent[code], 0);
+        emit(d.events, EV_SYN, SYN_REPORT, 0);
+      }
+    d.keys.held.reset();
+    d.layers.held.reset();
+    layerResolve(d.layers);
+    drainEvents(d.events);
+}
+
+void driverLost(tourbox_driver &d)
+{
+    if (d.lost != nullptr)
+      d.lost(d, d.lostCtx);
+    else
+      loopStop(*d.loop);
+}
+
+// Called only when the tty is readable, so there is no idle polling. Each
+// pass drains the tty into the ring with one syscall and decodes the lot.
+void driverSerial(loop_handler &h, uint32_t events)
+{
+    tourbox_driver &d = *static_cast<tourbox_driver *>(h.ctx);
+    uint64_t wakeNs = monotonicNs();
+    for (;;)
+    {
+      const ssize_t bytesRead = ringFill(d.ring, h.fd, d.stats);
+      if ((0 > bytesRead && EAGAIN == errno) || 0 == bytesRead)
+        break;                        // Drained (VMIN=0 ttys say so with 0), back to epoll_wait()
+      if (0 > bytesRead)              /* If there's a error accessing the buffer we dip out gracefuly...*/
+      {
+        driverLost(d);                // EIO once the TourBox is unplugged
+        return;
+      }
+      d.readNs = monotonicNs();
+      latencyRecord(*d.latency, STAGE_READ, d.readNs - wakeNs);
+      wakeNs = d.readNs;
+      if (d.record != nullptr)
+        traceRecord(*d.record, d.readNs, d.ring, d.ring.head - bytesRead, bytesRead);
+      decodeStream(d.ring, d.stats, driverDecoded, &d);
+      flushEvents(d.events);          // One write() for the whole burst
+    }
+    if (events & (EPOLLERR | EPOLLHUP))
+      driverLost(d);
+}
+
+// A read the io_uring loop kept posted has completed: the bytes are
+// already in hand, so there is no readiness wakeup and no read() to make.
+void driverRead(loop_handler &h, const uint8_t *data, ssize_t n)
+{
+    tourbox_driver &d = *static_cast<tourbox_driver *>(h.ctx);
+    if (0 >= n)
+    {
+      driverLost(d);                  // -EIO once the TourBox is unplugged
+      return;
+    }
+    ringPush(d.ring, data, n, d.stats);
+    d.readNs = monotonicNs();
+    if (d.record != nullptr)
+      traceRecord(*d.record, d.readNs, d.ring, d.ring.head - n, n);
+    decodeStream(d.ring, d.stats, driverDecoded, &d);
+    flushEvents(d.events);            // Queued on the ring, out with the next wait
+}
+
+// The loop's half of a threaded reader: decodes what the thread read, in
+// order, with the thread's timestamps, and writes the lot out at once.
+void driverChunks(loop_handler &h, uint32_t /*events*/)
+{
+    tourbox_driver &d = *static_cast<tourbox_driver *>(h.ctx);
+    uint64_t count;
+    if (read(h.fd, &count, sizeof(count)) != sizeof(count))
+      return;
+    reader_chunk chunk;
+    while (spscPop(d.reader->queue, chunk))
+    {
+      if (READER_LOST == chunk.len)
+      {
+        flushEvents(d.events);
+        driverLost(d);                // Stops the thread; nothing follows this
+        return;
+      }
+      latencyRecord(*d.latency, STAGE_HANDOFF, monotonicNs() - chunk.readNs);
+      ringPush(d.ring, chunk.bytes, chunk.len, d.stats);
+      d.readNs = chunk.readNs;
+      if (d.record != nullptr)
+        traceRecord(*d.record, d.readNs, d.ring, d.ring.head - chunk.len, chunk.len);
+      decodeStream(d.ring, d.stats, driverDecoded, &d);
+    }
+    readerRoom(*d.reader);
+    flushEvents(d.events);            // One write() for everything that was waiting
+}
+
+// Runs bytes that did not come from the tty (a replayed trace) through the
+// same ring, decoder and batch.
+void driverFeed(tourbox_driver &d, const uint8_t *data, uint32_t n)
+{
+    ringPush(d.ring, data, n, d.stats);
+    d.readNs = monotonicNs();
+    decodeStream(d.ring, d.stats, driverDecoded, &d);
+    flushEvents(d.events);
+}
+
+// Stops reading a tty that has gone away. The caller closes it; the sink
+// and everything else stay, ready for driverAttach().
+void driverDetach(tourbox_driver &d)
+{
+    driverRelease(d);
+    if (d.reader != nullptr)
+      readerStop(*d.reader);
+    loopRemove(*d.loop, d.serial);
+    d.serial = nullptr;
+}
+
+int driverAttach(tourbox_driver &d, int serialFd)
+{
+    if (d.reader != nullptr)
+      return readerStart(*d.reader, serialFd);
+    if (LOOP_URING == d.loop->backend)
+      d.serial = loopAddRead(*d.loop, serialFd, driverRead, &d);
+    else
+      d.serial = loopAdd(*d.loop, serialFd, EPOLLIN, driverSerial, &d);
+    return (d.serial != nullptr) ? 0 : -1;
+}
+
+// serialFd may be -1 when bytes arrive through driverFeed() instead; with
+// no wheel, macros are dropped. Set d.reader first to read it on a thread.
+int driverInit(tourbox_driver &d, event_loop &loop, int serialFd, output_sink *sink, latency_stats *latency,
+               timer_wheel *wheel = nullptr)
+{
+    d.loop = &loop;
+    d.latency = latency;
+    d.events.sink = sink;
+    d.events.latency = latency;
+    macroInit(d.macros, wheel, &d.events);
+    if (serialFd >= 0 && driverAttach(d, serialFd) != 0)
+        return -1;
+    if (clickInit(d.clicks, loop, driverClick, &d) != 0)
+        std::cerr << "Double click timers unavailable" << std::endl;
+    if (coalesceInit(d.coalesce, loop, &d.events, &d.scroll) != 0)
+        std::cerr << "Rotary coalescing unavailable" << std::endl;
+    return 0;
+}
+
+// Nothing is left held down on the sink, so it can be closed right after.
+void driverDestroy(tourbox_driver &d)
+{
+    driverRelease(d);
+    clickDestroy(d.clicks, *d.loop);
+    coalesceDestroy(d.coalesce, *d.loop);
+    if (d.reader != nullptr)
+      readerStop(*d.reader);
+    loopRemove(*d.loop, d.serial);
+    d.serial = nullptr;
+}
+
+void driverPrintStats(const tourbox_driver &d)
+{
+    std::cout << "serial: " << d.stats.reads << " reads, "
+              << d.stats.bytes << " bytes, "
+              << d.stats.events << " events, "
+              << d.stats.unknown << " unknown, "
+              << d.stats.overflow << " overflowed, "
+              << d.events.writes << " " << sinkNames[d.events.sink->kind] << " writes" << std::endl;
+    if (d.coalesce.detents > d.coalesce.reports)
+        std::cout << "rotary: " << d.coalesce.detents << " detents in "
+                  << d.coalesce.reports << " reports" << std::endl;
+    if (d.reader != nullptr)
+        std::cout << "reader: queue peaked at " << d.reader->queue.highWater.load() << " of "
+                  << READER_QUEUE_SIZE << " reads, full " << d.reader->queue.overflow.load() << " times" << std::endl;
+}
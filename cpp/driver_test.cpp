@@ -0,0 +1,395 @@
+/**
+ * @file driver_test.cpp
+ * @brief End-to-end checks of the input pipeline: raw TourBox bytes go
+ *        in through driverFeed(), the same ring, decoder, keymap and
+ *        batch the daemon uses run over them, and the input_events that
+ *        reach a memory sink are compared with what should come out.
+ *        Each case runs on both event loop backends; ctest runs them one
+ *        by one by name. Exits non-zero on failure.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <initializer_list>
+#include <memory>
+#include <sched.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+// Local
+#include "uinput_helper.h"
+#include "event_loop.h"
+#include "driver.h"
+#include "latency.h"
+#include "serial_reader.h"
+#include "spsc_queue.h"
+
+struct sent_event {
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+};
+
+// One driver on a memory sink, reading the rig's own keymap. Cases set
+// up map before rigOpen() and may change it between feeds.
+struct test_rig {
+    event_loop loop;
+    output_sink sink;
+    latency_stats latency;
+    keymap map;
+    keymap_slot profile{&map};
+    tourbox_driver d;
+    const char *name = "";
+};
+
+bool rigOpen(test_rig &r, loop_backend backend)
+{
+    if (loopInit(r.loop, backend) < 0 || sinkOpen(r.sink, "memory") != 0
+     || driverInit(r.d, r.loop, -1, &r.sink, &r.latency) != 0) {
+        perror("driver_test: setup");
+        return false;
+    }
+    r.d.profile = &r.profile;
+    r.name = (LOOP_URING == r.loop.backend) ? "io_uring" : "epoll";   // Falls back without io_uring
+    return true;
+}
+
+void rigClose(test_rig &r)
+{
+    driverDestroy(r.d);
+    sinkClose(r.sink);
+    loopDestroy(r.loop);
+}
+
+// All the bytes arrive as one read.
+void rigFeed(test_rig &r, std::initializer_list<uint8_t> bytes)
+{
+    driverFeed(r.d, bytes.begin(), bytes.size());
+}
+
+void onRigDone(loop_handler &h, uint32_t /*events*/)
+{
+    timerAck(h.fd);
+    loopStop(*static_cast<event_loop *>(h.ctx));
+}
+
+// Lets the loop run its timers for ms.
+void rigRun(test_rig &r, long ms)
+{
+    const int fd = timerOpen();
+    loop_handler *h = loopAdd(r.loop, fd, EPOLLIN, onRigDone, &r.loop);
+    timerArm(fd, ms * 1000000L);
+    loopRun(r.loop);
+    loopRemove(r.loop, h);
+    close(fd);
+}
+
+// Compares what the sink got since the last check with want, then starts
+// over. Timestamps are not compared.
+bool rigExpect(test_rig &r, const char *what, std::initializer_list<sent_event> want)
+{
+    const std::vector<struct input_event> &got = r.sink.captured;
+    bool ok = got.size() == want.size();
+    for (size_t i = 0; ok && i < got.size(); i++) {
+        const sent_event &w = want.begin()[i];
+        ok = got[i].type == w.type && got[i].code == w.code && got[i].value == w.value;
+    }
+    printf("%s: %s: %s\n", r.name, what, ok ? "ok" : "FAILED");
+    if (!ok) {
+        for (const sent_event &w : want)
+            printf("  want %u %u %d\n", w.type, w.code, w.value);
+        for (const struct input_event &ev : got)
+            printf("  got  %u %u %d\n", ev.type, ev.code, ev.value);
+    }
+    r.sink.captured.clear();
+    return ok;
+}
+
+bool rigCheck(test_rig &r, const char *what, bool ok)
+{
+    printf("%s: %s: %s\n", r.name, what, ok ? "ok" : "FAILED");
+    r.sink.captured.clear();
+    return ok;
+}
+
+// A burst read in one go decodes in one pass and goes out in one write.
+// Bytes that mean nothing and bytes the ring had no room for are counted.
+bool caseDecoder(test_rig &r)
+{
+    bool ok = true;
+    rigFeed(r, {DPAD_UP, 0x01, DPAD_DOWN, 0x00});
+    ok = rigExpect(r, "burst of taps", {{EV_KEY, KEY_UP, 1}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_KEY, KEY_UP, 0}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_KEY, KEY_DOWN, 1}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_KEY, KEY_DOWN, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    ok = rigCheck(r, "unknown bytes counted", 2 == r.d.stats.unknown && 2 == r.d.stats.events
+                                              && 1 == r.d.events.writes) && ok;
+
+    std::vector<uint8_t> flood(SERIAL_RING_SIZE + 88, DPAD_LEFT);
+    driverFeed(r.d, flood.data(), flood.size());
+    ok = rigCheck(r, "overflow counted", 88 == r.d.stats.overflow
+                                         && 4 * SERIAL_RING_SIZE == r.sink.captured.size()) && ok;
+    return ok;
+}
+
+// Buttons with a release byte are held for real. Release bytes of taps
+// and detents, and releases of keys that are not down, send nothing.
+bool caseHold(test_rig &r)
+{
+    bool ok = true;
+    rigFeed(r, {MOON});
+    ok = rigExpect(r, "press goes down", {{EV_KEY, KEY_FORWARD, 1}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    rigFeed(r, {MOON});
+    ok = rigExpect(r, "repeated press says nothing", {}) && ok;
+    rigFeed(r, {MOON | 0x80});
+    ok = rigExpect(r, "release comes up", {{EV_KEY, KEY_FORWARD, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    rigFeed(r, {MOON | 0x80, KNOB_CLOCK | 0x80});
+    ok = rigExpect(r, "stray releases say nothing", {}) && ok;
+    return ok;
+}
+
+// A click that could become a double click waits on a timer while other
+// controls keep flowing; one whose DBL_* code is unmapped does not wait.
+bool caseDoubleClick(test_rig &r)
+{
+    bool ok = true;
+    rigFeed(r, {PINKIE, DPAD_UP});
+    ok = rigExpect(r, "others flow while a click waits", {{EV_KEY, KEY_UP, 1}, {EV_SYN, SYN_REPORT, 0},
+                                                         {EV_KEY, KEY_UP, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    rigRun(r, 3 * DBL_CLICK_WINDOW_NS / 1000000);
+    ok = rigExpect(r, "single click after the window", {{EV_KEY, KEY_FORWARD, 1}, {EV_SYN, SYN_REPORT, 0},
+                                                       {EV_KEY, KEY_FORWARD, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    rigFeed(r, {PINKIE});
+    rigFeed(r, {DBL_PINKIE});
+    rigRun(r, 3 * DBL_CLICK_WINDOW_NS / 1000000);
+    ok = rigExpect(r, "double click replaces it", {{EV_KEY, KEY_ALL_APPLICATIONS, 1}, {EV_SYN, SYN_REPORT, 0},
+                                                  {EV_KEY, KEY_ALL_APPLICATIONS, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+
+    r.map.actions[DBL_SIDE] = key_action();
+    rigFeed(r, {SIDE});
+    ok = rigExpect(r, "unmapped double click does not wait", {{EV_KEY, KEY_CALC, 1}, {EV_SYN, SYN_REPORT, 0},
+                                                             {EV_KEY, KEY_CALC, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    return ok;
+}
+
+// The wheel sends 120ths on the hi-res axis and a legacy click each time
+// they add up to a whole detent, in the same report.
+bool caseHiresScroll(test_rig &r)
+{
+    bool ok = true;
+    rigFeed(r, {WHEEL_UP, WHEEL_DOWN});
+    ok = rigExpect(r, "a detent is 120", {{EV_REL, REL_WHEEL_HI_RES, 120}, {EV_REL, REL_WHEEL, 1}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_REL, REL_WHEEL_HI_RES, -120}, {EV_REL, REL_WHEEL, -1}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+
+    r.map.accel.enabled = true;      // Precision mode: a quarter step per detent
+    r.map.accel.precisionKey = MOON;
+    rigFeed(r, {MOON, WHEEL_UP, WHEEL_UP, WHEEL_UP, WHEEL_UP, MOON | 0x80});
+    ok = rigExpect(r, "quarter detents", {{EV_REL, REL_WHEEL_HI_RES, 30}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_REL, REL_WHEEL_HI_RES, 30}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_REL, REL_WHEEL_HI_RES, 30}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_REL, REL_WHEEL_HI_RES, 30}, {EV_REL, REL_WHEEL, 1}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+
+    r.map.accel.enabled = false;
+    r.map.hiresScroll = false;
+    rigFeed(r, {WHEEL_UP});
+    ok = rigExpect(r, "legacy only when turned off", {{EV_REL, REL_WHEEL, 1}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    return ok;
+}
+
+key_action layerAction(uint8_t layer, layer_mode mode)
+{
+    key_action a;
+    a.kind = ACTION_LAYER;
+    a.code = layer;
+    a.rel = mode;
+    return a;
+}
+
+// MOON shifts to layer 1 while held, NINTENDO_A toggles it and NINTENDO_B
+// arms layer 2 for one press. A key held across a layer change lets go of
+// what it pressed.
+bool caseLayers(test_rig &r)
+{
+    bool ok = true;
+    r.map.actions[MOON] = layerAction(1, LAYER_HOLD);
+    r.map.actions[NINTENDO_A] = layerAction(1, LAYER_TOGGLE);
+    r.map.actions[NINTENDO_B] = layerAction(2, LAYER_ONESHOT);
+    r.map.layers.assign(2, r.map.actions);
+    r.map.layers[0][DPAD_UP].code = KEY_A;
+    r.map.layers[0][KNOB_PRESS].code = KEY_C;
+    r.map.layers[1][DPAD_UP].code = KEY_B;
+
+    rigFeed(r, {MOON, DPAD_UP, KNOB_PRESS, MOON | 0x80, KNOB_PRESS | 0x80, DPAD_UP});
+    ok = rigExpect(r, "hold", {{EV_KEY, KEY_A, 1}, {EV_SYN, SYN_REPORT, 0}, {EV_KEY, KEY_A, 0}, {EV_SYN, SYN_REPORT, 0},
+                              {EV_KEY, KEY_C, 1}, {EV_SYN, SYN_REPORT, 0}, {EV_KEY, KEY_C, 0}, {EV_SYN, SYN_REPORT, 0},
+                              {EV_KEY, KEY_UP, 1}, {EV_SYN, SYN_REPORT, 0}, {EV_KEY, KEY_UP, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    rigFeed(r, {NINTENDO_A, NINTENDO_A | 0x80, DPAD_UP, NINTENDO_A, NINTENDO_A | 0x80, DPAD_UP});
+    ok = rigExpect(r, "toggle", {{EV_KEY, KEY_A, 1}, {EV_SYN, SYN_REPORT, 0}, {EV_KEY, KEY_A, 0}, {EV_SYN, SYN_REPORT, 0},
+                                {EV_KEY, KEY_UP, 1}, {EV_SYN, SYN_REPORT, 0}, {EV_KEY, KEY_UP, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    rigFeed(r, {NINTENDO_B, NINTENDO_B | 0x80, DPAD_UP, DPAD_UP});
+    ok = rigExpect(r, "one-shot", {{EV_KEY, KEY_B, 1}, {EV_SYN, SYN_REPORT, 0}, {EV_KEY, KEY_B, 0}, {EV_SYN, SYN_REPORT, 0},
+                                  {EV_KEY, KEY_UP, 1}, {EV_SYN, SYN_REPORT, 0}, {EV_KEY, KEY_UP, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    ok = rigCheck(r, "back on the base layer", 0 == r.d.layers.active) && ok;
+    return ok;
+}
+
+// With a 50 ms window the first detent of a turn goes out at once and the
+// rest wait for the window, merged: one wheel report with the sum, or all
+// the key taps in one batch. A reversal sends what was waiting first.
+bool caseCoalesce(test_rig &r)
+{
+    bool ok = true;
+    r.map.accel.coalesceNs = 50000000;
+    rigFeed(r, {KNOB_CLOCK, KNOB_CLOCK, KNOB_CLOCK, WHEEL_UP, WHEEL_UP, WHEEL_UP});
+    ok = rigExpect(r, "first detents at once", {{EV_KEY, KEY_VOLUMEUP, 1}, {EV_SYN, SYN_REPORT, 0},
+                                               {EV_KEY, KEY_VOLUMEUP, 0}, {EV_SYN, SYN_REPORT, 0},
+                                               {EV_REL, REL_WHEEL_HI_RES, 120}, {EV_REL, REL_WHEEL, 1}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    rigRun(r, 100);
+    ok = rigExpect(r, "the rest merged", {{EV_REL, REL_WHEEL_HI_RES, 240}, {EV_REL, REL_WHEEL, 2}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_KEY, KEY_VOLUMEUP, 1}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_KEY, KEY_VOLUMEUP, 0}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_KEY, KEY_VOLUMEUP, 1}, {EV_SYN, SYN_REPORT, 0},
+                                         {EV_KEY, KEY_VOLUMEUP, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    ok = rigCheck(r, "6 detents in 4 reports", 6 == r.d.coalesce.detents && 4 == r.d.coalesce.reports) && ok;
+
+    rigFeed(r, {KNOB_CLOCK, KNOB_COUNTER, KNOB_COUNTER, KNOB_CLOCK});
+    ok = rigExpect(r, "reversal flushes", {{EV_KEY, KEY_VOLUMEUP, 1}, {EV_SYN, SYN_REPORT, 0},
+                                          {EV_KEY, KEY_VOLUMEUP, 0}, {EV_SYN, SYN_REPORT, 0},
+                                          {EV_KEY, KEY_VOLUMEDOWN, 1}, {EV_SYN, SYN_REPORT, 0},
+                                          {EV_KEY, KEY_VOLUMEDOWN, 0}, {EV_SYN, SYN_REPORT, 0},
+                                          {EV_KEY, KEY_VOLUMEDOWN, 1}, {EV_SYN, SYN_REPORT, 0},
+                                          {EV_KEY, KEY_VOLUMEDOWN, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    rigRun(r, 100);
+    ok = rigExpect(r, "last one on time", {{EV_KEY, KEY_VOLUMEUP, 1}, {EV_SYN, SYN_REPORT, 0},
+                                          {EV_KEY, KEY_VOLUMEUP, 0}, {EV_SYN, SYN_REPORT, 0}}) && ok;
+    return ok;
+}
+
+// One thread pushes a count, the other pops it back in order. Both yield
+// when they cannot go on, so this works on a single CPU too.
+bool spscInOrder(void)
+{
+    static spsc_queue<uint32_t, 64> queue;
+    const uint32_t count = 100000;
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < count; i++)
+            while (!spscPush(queue, i))
+                sched_yield();
+    });
+    uint32_t next = 0, item;
+    bool ordered = true;
+    while (next < count) {
+        if (spscPop(queue, item))
+            ordered = (item == next++) && ordered;
+        else
+            sched_yield();
+    }
+    producer.join();
+    return ordered && queue.highWater.load() <= 64;
+}
+
+// Writes one byte to the reader's pipe and waits for it to be queued on
+// its own, so every byte is a chunk.
+bool readerSend(serial_reader &reader, int fd, uint8_t byte)
+{
+    const size_t tail = reader.queue.tail.load();
+    if (write(fd, &byte, 1) != 1)
+        return false;
+    for (int spins = 0; reader.queue.tail.load() == tail; spins++) {
+        if (spins > 100000)
+            return false;
+        usleep(10);
+    }
+    return true;
+}
+
+// A reader thread on a pipe fills the queue while the loop is not
+// running. It then has to wait for room, lose nothing once the loop
+// drains the queue, and still let go when stopped while it waits.
+bool caseReader(test_rig &r)
+{
+    bool ok = rigCheck(r, "queue hands over in order", spscInOrder());
+    serial_reader reader;
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0 || readerInit(reader, r.loop, driverChunks, &r.d) != 0) {
+        perror("driver_test: reader");
+        return false;
+    }
+    r.d.reader = &reader;
+    readerStart(reader, fds[0]);
+    bool sent = true;
+    for (unsigned i = 0; sent && i < READER_QUEUE_SIZE; i++)
+        sent = readerSend(reader, fds[1], (i & 1) ? DPAD_DOWN : DPAD_UP);
+    const uint8_t more[] = {DPAD_LEFT, DPAD_RIGHT};
+    sent = sent && write(fds[1], more, sizeof(more)) == sizeof(more);
+    for (int spins = 0; sent && 0 == reader.queue.overflow.load() && spins < 100000; spins++)
+        usleep(10);
+    ok = rigCheck(r, "queue full", sent && reader.queue.overflow.load() > 0) && ok;
+
+    rigRun(r, 100);
+    const std::vector<struct input_event> &got = r.sink.captured;
+    bool ordered = got.size() == 4 * (READER_QUEUE_SIZE + 2);
+    for (size_t i = 0; ordered && i < got.size(); i += 4) {
+        const unsigned n = i / 4;
+        const uint16_t key = (n < READER_QUEUE_SIZE) ? ((n & 1) ? KEY_DOWN : KEY_UP)
+                                                     : ((n == READER_QUEUE_SIZE) ? KEY_LEFT : KEY_RIGHT);
+        ordered = got[i].code == key && 1 == got[i].value;
+    }
+    ok = rigCheck(r, "everything after the drain, in order", ordered) && ok;
+
+    for (unsigned i = 0; sent && i < READER_QUEUE_SIZE; i++)
+        sent = readerSend(reader, fds[1], DPAD_UP);
+    sent = sent && write(fds[1], more, sizeof(more)) == sizeof(more);
+    usleep(10000);
+    readerStop(reader);          // Hangs if the thread cannot be woken while it waits
+    ok = rigCheck(r, "stops while waiting for room", sent && !reader.thread.joinable()) && ok;
+
+    readerDestroy(reader);
+    r.d.reader = nullptr;
+    close(fds[0]);
+    close(fds[1]);
+    return ok;
+}
+
+struct test_case {
+    const char *name;
+    bool (*run)(test_rig &r);
+};
+
+static constexpr test_case cases[] = {
+    {"decoder", caseDecoder},
+    {"hold", caseHold},
+    {"double_click", caseDoubleClick},
+    {"hires_scroll", caseHiresScroll},
+    {"layers", caseLayers},
+    {"coalesce", caseCoalesce},
+    {"reader", caseReader},
+};
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+    bool found = false;
+    for (const test_case &c : cases) {
+        if (argc > 1 && strcmp(argv[1], c.name) != 0)
+            continue;
+        found = true;
+        for (loop_backend backend : {LOOP_EPOLL, LOOP_URING}) {
+            auto r = std::make_unique<test_rig>();
+            if (!rigOpen(*r, backend))
+                return 1;
+            ok = c.run(*r) && ok;
+            rigClose(*r);
+        }
+    }
+    if (!found)
+        fprintf(stderr, "Unknown case: %s\n", argv[1]);
+    return (ok && found) ? 0 : 1;
+}
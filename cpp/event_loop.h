@@ -0,0 +1,633 @@
+/*
+ * @file event_loop.h
+ * @brief Small reactor for the driver. The serial port, timers and
+ *        signals are all plain file descriptors registered here, so the
+ *        process sleeps until one of them is ready instead of polling the
+ *        tty on a fixed interval. Two backends, picked at loopInit():
+ *        epoll, and io_uring (Linux 6.1+), where every fd is a multishot
+ *        poll, a tty keeps a read posted into a registered buffer and
+ *        uinput writes are queued as linked submissions, so a whole round
+ *        of completions and the next wait cost one io_uring_enter().
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <initializer_list>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "uring.h"
+
+#define LOOP_MAX_HANDLERS 64   // Three per device (tty, click and rotary timers), two per
+                               // extra profile, plus signals, a few timers and the sockets
+#define LOOP_MAX_EVENTS   16   // epoll_wait() batch size
+#define LOOP_MAX_WRITERS   8   // io_uring: fds written through the ring, a sink per device
+#define LOOP_READ_SIZE   256   // io_uring: bytes per posted read
+#define LOOP_WRITE_SLOTS  16   // io_uring: writes in flight, one bit each in writeBusy
+#define LOOP_WRITE_SIZE 8192   // io_uring: several event batches; anything bigger is written directly
+#define LOOP_URING_SIZE  256   // io_uring: submission queue entries
+#define LOOP_DRAIN_NS 100000000L // io_uring: how long an exit waits for writes still in flight
+#define LOOP_BUFFER_SIZE (LOOP_MAX_HANDLERS * LOOP_READ_SIZE + LOOP_WRITE_SLOTS * LOOP_WRITE_SIZE)
+
+enum loop_backend : uint8_t {
+    LOOP_EPOLL = 0,
+    LOOP_URING,
+};
+
+static constexpr const char *loopBackendNames[] = {"epoll", "io_uring"};
+
+struct loop_handler;
+typedef void (*loop_callback)(loop_handler &h, uint32_t events);
+// io_uring reads: n bytes at data, or 0 / -errno once the read failed.
+typedef void (*loop_read_callback)(loop_handler &h, const uint8_t *data, ssize_t n);
+
+struct loop_handler {
+    int fd = -1;
+    loop_callback cb = nullptr;
+    void *ctx = nullptr;
+    uint32_t events = 0;
+    loop_read_callback onRead = nullptr;   // io_uring: a read is kept posted instead
+    uint32_t generation = 0;   // io_uring: completions for an earlier user of the slot are dropped
+};
+
+// What an io_uring completion was for, in the low byte of its user_data
+enum loop_op : uint8_t {
+    LOOP_OP_POLL = 1,
+    LOOP_OP_READ,
+    LOOP_OP_READ_POLL,   // Linked ahead of each read; reports only failures
+    LOOP_OP_WRITE,
+    LOOP_OP_CANCEL,
+};
+
+struct event_loop {
+    int epfd = -1;
+    bool running = false;
+    loop_backend backend = LOOP_EPOLL;
+    std::array<loop_handler, LOOP_MAX_HANDLERS> handlers;
+    uint64_t waits = 0;          // epoll_wait() or io_uring_enter() calls that slept
+    // io_uring only. The registered file table is a slot per handler,
+    // then the writers; the registered buffer a read per handler, then
+    // the write slots.
+    uring ring;
+    uint8_t *buffers = nullptr;
+    std::array<int, LOOP_MAX_WRITERS> writers;
+    uint32_t writeBusy = 0;      // Write slots in flight
+    std::array<uint8_t, LOOP_WRITE_SLOTS> slotWriter = {};   // Whose write each busy slot holds
+    std::array<uint32_t, LOOP_WRITE_SLOTS> slotLen = {};     // And how many bytes of it
+    std::array<unsigned, LOOP_MAX_WRITERS> writerBusy = {};  // Slots each writer has queued or in flight
+    std::array<std::deque<std::vector<uint8_t>>, LOOP_MAX_WRITERS> backlog;   // Writes held back, in order
+    std::array<unsigned, LOOP_MAX_WRITERS> requeued = {};    // Of those, left over from the writes in flight
+    unsigned lastWrite = 0;      // Queue position of the last write, to merge into or link behind
+    unsigned lastWriteSlot = 0;
+    int lastWriteFile = -1;
+    uint64_t writesQueued = 0;
+    uint64_t writesMerged = 0;   // Appended to a write still waiting to be submitted
+    uint64_t writesDirect = 0;   // Written with write(): too big, or after the loop stopped
+    uint64_t writesDeferred = 0; // Held back until the writer's earlier writes completed or a slot freed up
+    uint64_t writeErrors = 0;
+};
+
+static_assert(LOOP_WRITE_SLOTS <= 32, "writeBusy has a bit per write slot");
+
+inline unsigned loopIndex(const event_loop &loop, const loop_handler &h) { return &h - loop.handlers.data(); }
+inline uint64_t loopTag(loop_op op, unsigned index, uint32_t generation)
+{
+    return (uint64_t)generation << 32 | index << 8 | op;
+}
+inline uint8_t *loopReadBuffer(event_loop &loop, unsigned index) { return loop.buffers + index * LOOP_READ_SIZE; }
+inline uint8_t *loopWriteBuffer(event_loop &loop, unsigned slot)
+{
+    return loop.buffers + LOOP_MAX_HANDLERS * LOOP_READ_SIZE + slot * LOOP_WRITE_SIZE;
+}
+
+void loopUringDestroy(event_loop &loop)
+{
+    uringDestroy(loop.ring);
+    if (loop.buffers != nullptr)
+        munmap(loop.buffers, LOOP_BUFFER_SIZE);
+    loop.buffers = nullptr;
+}
+
+// A single issuer with deferred task work: completions are only posted
+// while we are in io_uring_enter() anyway, so nothing interrupts the loop
+// thread to post them. Both need 6.1; older kernels get epoll.
+int loopUringInit(event_loop &loop)
+{
+    if (uringInit(loop.ring, LOOP_URING_SIZE, IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN) != 0) {
+        fprintf(stderr, "io_uring: %s (needs Linux 6.1), using epoll\n", strerror(errno));
+        return -1;
+    }
+    void *buffers = mmap(nullptr, LOOP_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    loop.buffers = (buffers != MAP_FAILED) ? static_cast<uint8_t *>(buffers) : nullptr;
+    std::array<int, LOOP_MAX_HANDLERS + LOOP_MAX_WRITERS> files;
+    files.fill(-1);              // Filled in by loopAdd() and loopAddWriter()
+    struct iovec iov = {loop.buffers, LOOP_BUFFER_SIZE};
+    if (loop.buffers == nullptr
+     || uringRegister(loop.ring, IORING_REGISTER_BUFFERS, &iov, 1) != 0
+     || uringRegister(loop.ring, IORING_REGISTER_FILES, files.data(), files.size()) != 0) {
+        fprintf(stderr, "io_uring: cannot register buffers and files: %s, using epoll\n", strerror(errno));
+        loopUringDestroy(loop);
+        return -1;
+    }
+    loop.writers.fill(-1);
+    loop.backend = LOOP_URING;
+    return 0;
+}
+
+// Returns the epoll or io_uring fd, or -1. Asking for io_uring where it
+// cannot be had gets epoll, with a warning.
+int loopInit(event_loop &loop, loop_backend backend = LOOP_EPOLL)
+{
+    if (LOOP_URING == backend && loopUringInit(loop) == 0)
+        return loop.ring.fd;
+    loop.backend = LOOP_EPOLL;
+    loop.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop.epfd < 0)
+        perror("epoll_create1");
+    return loop.epfd;
+}
+
+// Whether the entry at queue position pos is still ours to change.
+inline bool loopUnsubmitted(const event_loop &loop, unsigned pos)
+{
+    return pos - *loop.ring.sqTail < loop.ring.sqLocal - *loop.ring.sqTail;
+}
+
+// Multishot: one submission, a completion every time the fd turns ready.
+bool loopPoll(event_loop &loop, loop_handler &h)
+{
+    struct io_uring_sqe *sqe = uringSqe(loop.ring);
+    if (sqe == nullptr)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = loopIndex(loop, h);
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->poll32_events = h.events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = loopTag(LOOP_OP_POLL, loopIndex(loop, h), h.generation);
+    return true;
+}
+
+// A read that completes only once there is something to read. The fd
+// stays non-blocking, so the read is linked behind a one-shot poll rather
+// than parked on a kernel worker; the poll's own completion is skipped.
+bool loopPostRead(event_loop &loop, loop_handler &h)
+{
+    const unsigned index = loopIndex(loop, h);
+    if (uringSpace(loop.ring) < 2)   // Both or neither: half of the pair would be a NOP
+        uringEnter(loop.ring, 0);
+    if (uringSpace(loop.ring) < 2) {
+        fprintf(stderr, "io_uring: queue full, fd %i is no longer read\n", h.fd);
+        return false;
+    }
+    struct io_uring_sqe *poll = uringSqe(loop.ring);
+    struct io_uring_sqe *read = uringSqe(loop.ring);
+    poll->opcode = IORING_OP_POLL_ADD;
+    poll->fd = index;
+    poll->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    poll->poll32_events = POLLIN;
+    poll->user_data = loopTag(LOOP_OP_READ_POLL, index, h.generation);
+    read->opcode = IORING_OP_READ_FIXED;
+    read->fd = index;
+    read->flags = IOSQE_FIXED_FILE;
+    read->addr = (uint64_t)(uintptr_t)loopReadBuffer(loop, index);
+    read->len = LOOP_READ_SIZE;
+    read->off = (uint64_t)-1;    // Current position; a tty has none
+    read->buf_index = 0;
+    read->user_data = loopTag(LOOP_OP_READ, index, h.generation);
+    return true;
+}
+
+loop_handler *loopClaim(event_loop &loop, int fd, void *ctx)
+{
+    for (auto &h : loop.handlers) {
+        if (h.cb != nullptr || h.onRead != nullptr)
+            continue;
+        h.fd = fd;
+        h.ctx = ctx;
+        h.generation++;
+        if (LOOP_URING == loop.backend && uringUpdateFile(loop.ring, loopIndex(loop, h), fd) != 0) {
+            perror("io_uring: register fd");
+            return nullptr;
+        }
+        return &h;
+    }
+    fprintf(stderr, "event loop: no free handler slot for fd %i\n", fd);
+    return nullptr;
+}
+
+void loopRelease(loop_handler &h)
+{
+    const uint32_t generation = h.generation;
+    h = loop_handler();
+    h.generation = generation;
+}
+
+// Registers fd with the reactor. The returned slot stays valid until
+// loopRemove(), so it is handed back to the callback unchanged.
+loop_handler *loopAdd(event_loop &loop, int fd, uint32_t events, loop_callback cb, void *ctx)
+{
+    loop_handler *h = loopClaim(loop, fd, ctx);
+    if (h == nullptr)
+        return nullptr;
+    h->cb = cb;
+    h->events = events;
+    if (LOOP_URING == loop.backend) {
+        if (!loopPoll(loop, *h)) {
+            loopRelease(*h);
+            return nullptr;
+        }
+        return h;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.ptr = h;
+    if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        perror("epoll_ctl(ADD)");
+        loopRelease(*h);
+        return nullptr;
+    }
+    return h;
+}
+
+// io_uring only: keeps a read of up to LOOP_READ_SIZE bytes posted on fd
+// and hands each one to onRead, with no readiness callback in between.
+loop_handler *loopAddRead(event_loop &loop, int fd, loop_read_callback onRead, void *ctx)
+{
+    if (LOOP_URING != loop.backend)
+        return nullptr;
+    loop_handler *h = loopClaim(loop, fd, ctx);
+    if (h == nullptr)
+        return nullptr;
+    h->onRead = onRead;
+    if (!loopPostRead(loop, *h)) {
+        loopRelease(*h);
+        return nullptr;
+    }
+    return h;
+}
+
+void loopRemove(event_loop &loop, loop_handler *h)
+{
+    if (h == nullptr || (h->cb == nullptr && h->onRead == nullptr))
+        return;
+    if (LOOP_URING == loop.backend) {
+        const unsigned index = loopIndex(loop, *h);
+        struct io_uring_sqe *sqe = uringSqe(loop.ring);
+        if (sqe != nullptr) {    // Whatever is still posted on it
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = index;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_FD_FIXED | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = loopTag(LOOP_OP_CANCEL, index, 0);
+        }
+        uringEnter(loop.ring, 0);    // Before its table slot is cleared
+        uringUpdateFile(loop.ring, index, -1);
+        // Completions only run while getting events: finish the cancel now,
+        // so nothing holds the fd any more once the caller closes it
+        uringEnter(loop.ring, 0, IORING_ENTER_GETEVENTS);
+    } else {
+        epoll_ctl(loop.epfd, EPOLL_CTL_DEL, h->fd, nullptr);
+    }
+    loopRelease(*h);
+}
+
+// io_uring: puts fd in the registered table for loopWrite(). Returns the
+// table slot to write to, or -1 to keep using write().
+int loopAddWriter(event_loop &loop, int fd)
+{
+    if (LOOP_URING != loop.backend || fd < 0)
+        return -1;
+    for (unsigned i = 0; i < LOOP_MAX_WRITERS; i++) {
+        if (loop.writers[i] >= 0)
+            continue;
+        if (uringUpdateFile(loop.ring, LOOP_MAX_HANDLERS + i, fd) != 0)
+            return -1;
+        loop.writers[i] = fd;
+        return LOOP_MAX_HANDLERS + i;
+    }
+    return -1;
+}
+
+// io_uring: copies n bytes into a registered write slot and queues them
+// for the writer's table slot. Until the loop's next io_uring_enter(),
+// further writes to the same fd are appended to that one, so a burst of
+// flushes goes out as a single write; when the slot is full the next
+// write is linked behind it, so they land in order even if one has to
+// wait. False, with nothing queued, when that order cannot be kept: the
+// writer has writes submitted that a new one could overtake, or there is
+// no free slot or entry.
+bool loopQueueWrite(event_loop &loop, int file, const void *data, size_t n)
+{
+    const unsigned writer = file - LOOP_MAX_HANDLERS;
+    const bool open = loop.lastWriteFile == file && loopUnsubmitted(loop, loop.lastWrite);
+    if (open) {
+        struct io_uring_sqe &last = loop.ring.sqes[loop.lastWrite & loop.ring.sqMask];
+        if (last.len + n <= LOOP_WRITE_SIZE) {
+            memcpy(reinterpret_cast<uint8_t *>(last.addr) + last.len, data, n);
+            last.len += n;
+            loop.slotLen[loop.lastWriteSlot] = last.len;
+            loop.writesMerged++;
+            return true;
+        }
+    }
+    const bool link = open && loop.lastWrite + 1 == loop.ring.sqLocal;
+    const unsigned slot = __builtin_ctzll(~(uint64_t)loop.writeBusy);   // LOOP_WRITE_SLOTS or more: all busy
+    if ((loop.writerBusy[writer] > 0 && !link) || n > LOOP_WRITE_SIZE || slot >= LOOP_WRITE_SLOTS
+     || 0 == uringSpace(loop.ring))
+        return false;
+    struct io_uring_sqe *sqe = uringSqe(loop.ring);
+    memcpy(loopWriteBuffer(loop, slot), data, n);
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = file;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)loopWriteBuffer(loop, slot);
+    sqe->len = n;
+    sqe->off = (uint64_t)-1;
+    sqe->buf_index = 0;
+    sqe->user_data = loopTag(LOOP_OP_WRITE, slot, 0);
+
+    if (link)
+        loop.ring.sqes[loop.lastWrite & loop.ring.sqMask].flags |= IOSQE_IO_LINK;
+    loop.lastWrite = loop.ring.sqLocal - 1;
+    loop.lastWriteSlot = slot;
+    loop.lastWriteFile = file;
+    loop.writeBusy |= 1u << slot;
+    loop.slotWriter[slot] = writer;
+    loop.slotLen[slot] = n;
+    loop.writerBusy[writer]++;
+    loop.writesQueued++;
+    return true;
+}
+
+// Queues a write to `file` (from loopAddWriter()), or holds it back behind
+// the writer's earlier ones until loopFlushWrites() can queue it, so
+// writes always land in the order they were made. Returns false only when
+// nothing of the writer's is pending and the caller's own write() is safe:
+// for an fd that is not a writer, or once the loop has stopped.
+bool loopWrite(event_loop &loop, int file, const void *data, size_t n)
+{
+    if (file < 0)
+        return false;
+    const unsigned writer = file - LOOP_MAX_HANDLERS;
+    std::deque<std::vector<uint8_t>> &backlog = loop.backlog[writer];
+    if (backlog.empty()) {
+        if (!loop.running && 0 == loop.writerBusy[writer]) {
+            loop.writesDirect++;
+            return false;
+        }
+        if (loop.running && loopQueueWrite(loop, file, data, n))
+            return true;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    backlog.emplace_back(bytes, bytes + n);
+    loop.writesDeferred++;
+    return true;
+}
+
+// Queues what writers held back, each once its earlier writes are done.
+// A write too big for a slot goes out with write() when nothing is ahead
+// of it.
+void loopFlushWrites(event_loop &loop)
+{
+    for (unsigned writer = 0; writer < LOOP_MAX_WRITERS; writer++) {
+        std::deque<std::vector<uint8_t>> &backlog = loop.backlog[writer];
+        const int file = LOOP_MAX_HANDLERS + writer;
+        while (!backlog.empty()) {
+            const std::vector<uint8_t> &next = backlog.front();
+            if (next.size() > LOOP_WRITE_SIZE && 0 == loop.writerBusy[writer]) {
+                if (write(loop.writers[writer], next.data(), next.size()) != (ssize_t)next.size())
+                    loop.writeErrors++;
+                loop.writesDirect++;
+            }
+            else if (!loopQueueWrite(loop, file, next.data(), next.size()))
+                break;
+            backlog.pop_front();
+        }
+    }
+}
+
+void loopComplete(event_loop &loop, const struct io_uring_cqe &cqe)
+{
+    const loop_op op = static_cast<loop_op>(cqe.user_data & 0xff);
+    const unsigned index = (cqe.user_data >> 8) & 0xffffff;
+    const uint32_t generation = cqe.user_data >> 32;
+    if (LOOP_OP_WRITE == op) {
+        const unsigned writer = loop.slotWriter[index];
+        const uint32_t len = loop.slotLen[index];
+        if ((cqe.res >= 0 && (uint32_t)cqe.res < len) || -ECANCELED == cqe.res) {
+            // A pipe took part of it, which breaks the link and cancels the
+            // writes behind it. What is left goes out again, in order and
+            // ahead of anything held back meanwhile.
+            const uint8_t *buffer = loopWriteBuffer(loop, index);
+            std::deque<std::vector<uint8_t>> &backlog = loop.backlog[writer];
+            backlog.emplace(backlog.begin() + loop.requeued[writer]++, buffer + (cqe.res > 0 ? cqe.res : 0), buffer + len);
+        }
+        else if (cqe.res < 0)
+            loop.writeErrors++;
+        loop.writeBusy &= ~(1u << index);
+        if (0 == --loop.writerBusy[writer])
+            loop.requeued[writer] = 0;
+        return;
+    }
+    if (index >= LOOP_MAX_HANDLERS || loop.handlers[index].generation != generation)
+        return;                  // A cancel, or for a handler since removed
+    loop_handler &h = loop.handlers[index];
+    switch (op) {
+      case LOOP_OP_POLL:
+        if (h.cb == nullptr || cqe.res < 0)
+            return;
+        h.cb(h, cqe.res);
+        if (!(cqe.flags & IORING_CQE_F_MORE) && h.generation == generation && h.cb != nullptr)
+            loopPoll(loop, h);   // The kernel ended the multishot
+        return;
+      case LOOP_OP_READ:
+        if (h.onRead == nullptr)
+            return;
+        if (-EAGAIN == cqe.res || -EINTR == cqe.res) {
+            loopPostRead(loop, h);
+            return;
+        }
+        h.onRead(h, loopReadBuffer(loop, index), cqe.res);
+        if (cqe.res > 0 && h.generation == generation && h.onRead != nullptr)
+            loopPostRead(loop, h);
+        return;
+      default:                   // A failed poll ahead of a read: the read reports it
+        return;
+    }
+}
+
+void loopStop(event_loop &loop)
+{
+    loop.running = false;
+}
+
+// Lands what the last callbacks queued or held back, so that whoever
+// write()s to the same fds after the loop stopped cannot overtake it. A
+// sink that takes none of it for LOOP_DRAIN_NS is given up on.
+void loopDrainWrites(event_loop &loop)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint64_t deadlineNs = now.tv_sec * 1000000000ULL + now.tv_nsec + LOOP_DRAIN_NS;
+    for (;;) {
+        loopFlushWrites(loop);
+        bool held = false;
+        for (const auto &backlog : loop.backlog)
+            held |= !backlog.empty();
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const uint64_t nowNs = now.tv_sec * 1000000000ULL + now.tv_nsec;
+        if ((0 == loop.writeBusy && !held) || nowNs >= deadlineNs)
+            break;
+        if (uringEnterTimeout(loop.ring, 1, deadlineNs - nowNs) < 0 && EINTR != errno && ETIME != errno)
+            break;
+        struct io_uring_cqe *cqe;
+        while ((cqe = uringCqe(loop.ring)) != nullptr) {
+            const struct io_uring_cqe done = *cqe;
+            uringSeen(loop.ring);
+            if (LOOP_OP_WRITE == (done.user_data & 0xff))   // The handlers are done
+                loopComplete(loop, done);
+        }
+    }
+    uringEnter(loop.ring, 0);
+    for (auto &backlog : loop.backlog) {
+        loop.writeErrors += backlog.size();
+        backlog.clear();
+    }
+}
+
+// One io_uring_enter() per pass: it submits what the last pass queued
+// (writes, fresh reads) and sleeps until something completes. It waits
+// for a single completion, never for the writes in flight: a tty read
+// that lands behind a slow write is handled straight away. Writes to
+// uinput complete inline while being submitted, so a pass that queued
+// some usually ends in a second enter that only reaps their results.
+void loopRunUring(event_loop &loop)
+{
+    while (loop.running) {
+        loopFlushWrites(loop);
+        loop.waits++;
+        if (uringEnter(loop.ring, 1) < 0 && EINTR != errno) {
+            perror("io_uring_enter");
+            break;
+        }
+        struct io_uring_cqe *cqe;
+        while (loop.running && (cqe = uringCqe(loop.ring)) != nullptr) {
+            const struct io_uring_cqe done = *cqe;   // Its slot may be reused by a callback's submit
+            uringSeen(loop.ring);
+            loopComplete(loop, done);
+        }
+    }
+    loopDrainWrites(loop);
+}
+
+// Blocks until loopStop() is called from one of the callbacks. There is no
+// timeout: anything time based is a timerfd registered like any other fd.
+void loopRun(event_loop &loop)
+{
+    std::array<struct epoll_event, LOOP_MAX_EVENTS> events;
+
+    loop.running = true;
+    if (LOOP_URING == loop.backend) {
+        loopRunUring(loop);
+        return;
+    }
+    while (loop.running) {
+        loop.waits++;
+        const int n = epoll_wait(loop.epfd, events.data(), events.size(), -1);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n && loop.running; i++) {
+            loop_handler *h = static_cast<loop_handler *>(events[i].data.ptr);
+            if (h->cb != nullptr)
+                h->cb(*h, events[i].events);
+        }
+    }
+}
+
+void loopDestroy(event_loop &loop)
+{
+    if (LOOP_URING == loop.backend)
+        loopUringDestroy(loop);
+    if (loop.epfd >= 0)
+        close(loop.epfd);
+    loop.epfd = -1;
+}
+
+/* === timerfd helpers === */
+
+int timerOpen(void)
+{
+    const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        perror("timerfd_create");
+    return fd;
+}
+
+// One-shot relative deadline. A zero timeout disarms the timer, so callers
+// wanting "now" should pass at least one nanosecond.
+void timerArm(int fd, long nsec)
+{
+    struct itimerspec its = {};
+    its.it_value.tv_sec = nsec / 1000000000L;
+    its.it_value.tv_nsec = nsec % 1000000000L;
+    timerfd_settime(fd, 0, &its, nullptr);
+}
+
+void timerDisarm(int fd)
+{
+    struct itimerspec its = {};
+    timerfd_settime(fd, 0, &its, nullptr);
+}
+
+// Returns the number of expirations since the last call (0 if spurious).
+uint64_t timerAck(int fd)
+{
+    uint64_t expirations = 0;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return 0;
+    return expirations;
+}
+
+/* === signalfd helper === */
+
+// Blocks the given signals for normal delivery and returns a signalfd that
+// reports them instead, so they are handled from the loop and not from
+// async signal context.
+int signalOpen(std::initializer_list<int> signals)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int s : signals)
+        sigaddset(&mask, s);
+
+    if (sigprocmask(SIG_BLOCK, &mask, nullptr) != 0) {
+        perror("sigprocmask");
+        return -1;
+    }
+    const int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+        perror("signalfd");
+    return fd;
+}
@@ -0,0 +1,276 @@
+/*
+ * @file exec_spawner.h
+ * @brief Runs `exec` actions without stalling input. A small helper
+ *        process is forked at startup, before the daemon has any devices,
+ *        threads or big allocations, and does every posix_spawn() on our
+ *        behalf. The loop only drops a request into a SEQPACKET socket;
+ *        the helper answers with the spawn time and, later, the exit
+ *        status, which end up in the latency stats and counters.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <spawn.h>
+#include <string>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "event_loop.h"
+#include "latency.h"
+
+#ifndef D
+ #define D(x)
+#endif
+
+extern char **environ;
+
+#define SPAWN_CMD_MAX 1024
+
+struct spawn_request {
+    uint32_t id;
+    uint64_t sentNs;
+    char cmd[SPAWN_CMD_MAX];   // NUL-terminated, run with /bin/sh -c
+};
+
+enum spawn_reply_kind : uint32_t {
+    SPAWN_STARTED = 0,         // posix_spawn() returned; err is its result
+    SPAWN_EXITED,              // status is from waitpid()
+};
+
+struct spawn_reply {
+    uint32_t id;
+    uint32_t kind;
+    int32_t err;
+    int32_t status;
+    uint64_t sentNs;
+    uint64_t doneNs;
+};
+
+struct exec_spawner {
+    int sock = -1;             // Our end of the socketpair
+    pid_t helper = -1;
+    uint32_t nextId = 1;
+    latency_stats *latency = nullptr;
+    event_loop *loop = nullptr;
+    loop_handler *handler = nullptr;
+    uint64_t requested = 0;
+    uint64_t dropped = 0;      // Helper backed up or gone
+    uint64_t spawned = 0;
+    uint64_t failed = 0;       // posix_spawn() itself failed
+    uint64_t exitedOk = 0;
+    uint64_t exitedError = 0;  // Non-zero exit or killed by a signal
+};
+
+// --- Helper process side -------------------------------------------------
+
+// Children are matched back to requests by pid in a small table; any that
+// overflow it are still reaped, just reported without an id.
+struct spawn_child {
+    pid_t pid;
+    uint32_t id;
+    uint64_t sentNs;
+};
+
+// Tells the daemon how each finished child exited.
+void spawnerReap(int sock, spawn_child *children, size_t n)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        spawn_reply reply = {0, SPAWN_EXITED, 0, status, 0, monotonicNs()};
+        for (size_t i = 0; i < n; i++)
+            if (children[i].pid == pid) {
+                reply.id = children[i].id;
+                reply.sentNs = children[i].sentNs;
+                children[i].pid = 0;
+                break;
+            }
+        send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+}
+
+[[noreturn]] void spawnerHelper(int sock)
+{
+    signal(SIGINT, SIG_IGN);       // Ctrl-C is for the daemon; we leave on EOF
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, nullptr);
+    const int sigFd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    posix_spawnattr_t attr;        // Children start with a clean mask and
+    posix_spawnattr_init(&attr);   // default SIGINT/SIGCHLD handling
+    sigset_t none, defaults;
+    sigemptyset(&none);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGCHLD);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    spawn_child children[64] = {};
+    spawn_request req;
+    struct pollfd fds[2] = {{sock, POLLIN, 0}, {sigFd, POLLIN, 0}};
+    for (;;) {
+        if (poll(fds, 2, -1) < 0 && EINTR != errno)
+            break;
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo si;
+            while (read(sigFd, &si, sizeof(si)) == sizeof(si))
+                ;
+            spawnerReap(sock, children, 64);
+        }
+        if (!(fds[0].revents & (POLLIN | POLLHUP)))
+            continue;
+        const ssize_t n = recv(sock, &req, sizeof(req), 0);
+        if (n <= 0)
+            break;                 // Daemon exited
+        if ((size_t)n < offsetof(spawn_request, cmd) + 1)
+            continue;
+        req.cmd[sizeof(req.cmd) - 1] = '\0';
+
+        char sh[] = "/bin/sh", dashC[] = "-c";
+        char *argv[] = {sh, dashC, req.cmd, nullptr};
+        pid_t pid = 0;
+        const int err = posix_spawn(&pid, "/bin/sh", nullptr, &attr, argv, environ);
+        const spawn_reply reply = {req.id, SPAWN_STARTED, err, 0, req.sentNs, monotonicNs()};
+        send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+        if (0 == err)
+            for (auto &child : children)
+                if (0 == child.pid) {
+                    child = {pid, req.id, req.sentNs};
+                    break;
+                }
+    }
+    spawnerReap(sock, children, 64);
+    _exit(0);
+}
+
+// --- Daemon side ---------------------------------------------------------
+
+// Forks the helper. Call early: the helper is a copy of whatever the
+// daemon looks like at this point, and should not hold its devices.
+int spawnerStart(exec_spawner &s, latency_stats *latency)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        perror("exec spawner: socketpair");
+        return -1;
+    }
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("exec spawner: fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (0 == pid) {
+        close(fds[0]);
+        spawnerHelper(fds[1]);
+    }
+    close(fds[1]);
+    s.sock = fds[0];
+    s.helper = pid;
+    s.latency = latency;
+    return 0;
+}
+
+void onSpawnerReply(loop_handler &h, uint32_t events)
+{
+    exec_spawner &s = *static_cast<exec_spawner *>(h.ctx);
+    spawn_reply reply;
+    while (recv(h.fd, &reply, sizeof(reply), MSG_DONTWAIT) == sizeof(reply)) {
+        if (SPAWN_STARTED == reply.kind) {
+            if (reply.err != 0) {
+                s.failed++;
+                fprintf(stderr, "exec #%u: %s\n", reply.id, strerror(reply.err));
+                continue;
+            }
+            s.spawned++;
+            if (s.latency)
+                latencyRecord(*s.latency, STAGE_SPAWN, reply.doneNs - reply.sentNs);
+        }
+        else if (WIFEXITED(reply.status) && 0 == WEXITSTATUS(reply.status))
+            s.exitedOk++;
+        else {
+            s.exitedError++;
+            D(printf("exec #%u: %s %i\n", reply.id, WIFSIGNALED(reply.status) ? "killed by signal" : "exit status",
+                     WIFSIGNALED(reply.status) ? WTERMSIG(reply.status) : WEXITSTATUS(reply.status));)
+        }
+    }
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        std::cerr << "exec spawner went away; exec actions are disabled" << std::endl;
+        loopRemove(*s.loop, s.handler);
+        s.handler = nullptr;
+    }
+}
+
+int spawnerAttach(exec_spawner &s, event_loop &loop)
+{
+    s.loop = &loop;
+    s.handler = loopAdd(loop, s.sock, EPOLLIN, onSpawnerReply, &s);
+    return (s.handler != nullptr) ? 0 : -1;
+}
+
+// Called from the loop. Never blocks: if the helper is not keeping up the
+// request is dropped and counted, input carries on either way.
+bool spawnerRun(exec_spawner &s, const std::string &cmd)
+{
+    s.requested++;
+    if (s.handler == nullptr || cmd.size() >= SPAWN_CMD_MAX) {
+        s.dropped++;
+        return false;
+    }
+    spawn_request req;
+    req.id = s.nextId++;
+    req.sentNs = monotonicNs();
+    memcpy(req.cmd, cmd.c_str(), cmd.size() + 1);
+    const size_t len = offsetof(spawn_request, cmd) + cmd.size() + 1;
+    if (send(s.sock, &req, len, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)len) {
+        s.dropped++;
+        return false;
+    }
+    D(printf("exec #%u: %s\n", req.id, req.cmd);)
+    return true;
+}
+
+// Closing our end is the helper's cue to reap what it can and leave.
+// Commands it started keep running.
+void spawnerStop(exec_spawner &s)
+{
+    if (s.loop != nullptr)
+        loopRemove(*s.loop, s.handler);
+    s.handler = nullptr;
+    if (s.sock >= 0)
+        close(s.sock);
+    if (s.helper > 0)
+        waitpid(s.helper, nullptr, 0);
+    s.sock = -1;
+    s.helper = -1;
+}
+
+void spawnerPrintStats(const exec_spawner &s)
+{
+    if (0 == s.requested)
+        return;
+    std::cout << "exec: " << s.requested << " requested, "
+              << s.spawned << " spawned, "
+              << s.failed << " failed to spawn, "
+              << s.dropped << " dropped, "
+              << s.exitedOk << " exited ok, "
+              << s.exitedError << " exited with errors" << std::endl;
+}
@@ -0,0 +1,174 @@
+/*
+ * @file hotplug.h
+ * @brief Reconnects a TourBox that was unplugged. The device's tty is
+ *        closed and its driver detached, but its virtual device stays, so
+ *        the compositor never sees it go. An inotify watch on the tty's
+ *        directory notices the node coming back (and udev fixing its
+ *        permissions), the port is set up again and reading resumes on
+ *        the same uinput fd. A slow retry timer covers anything inotify
+ *        cannot see, like a /dev/serial/by-id directory being recreated.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "driver.h"
+#include "event_loop.h"
+#include "keymap.h"
+#include "latency.h"
+#include "serial_port.h"
+
+#define HOTPLUG_RETRY_NS 1000000000L   // 1 s
+
+struct hotplug_watch;
+
+// A device's tty and whether it is there.
+struct serial_link {
+    serial_port port;
+    tourbox_driver *driver = nullptr;
+    hotplug_watch *watch = nullptr;
+    int wd = -1;                 // Watch on the tty's directory, once needed
+    uint64_t lostNs = 0;         // 0 = connected
+    uint64_t disconnects = 0;
+    uint64_t reconnects = 0;
+};
+
+struct hotplug_watch {
+    int inotifyFd = -1;
+    int retryFd = -1;
+    event_loop *loop = nullptr;
+    latency_stats *latency = nullptr;
+    std::array<serial_link *, KEYMAP_MAX_DEVICES> links = {};
+    unsigned count = 0;
+};
+
+inline bool linkWaiting(const serial_link &link) { return link.lostNs != 0; }
+
+// Opens the tty again if it is back. Quiet on failure: most attempts are
+// for some other node in /dev.
+bool hotplugTry(serial_link &link)
+{
+    if (serialOpen(link.port) < 0)
+        return false;
+    if (driverAttach(*link.driver, link.port.fd) != 0) {
+        serialClose(link.port);
+        return false;
+    }
+    const uint64_t downNs = monotonicNs() - link.lostNs;
+    if (link.watch->latency)
+        latencyRecord(*link.watch->latency, STAGE_RECONNECT, downNs);
+    link.lostNs = 0;
+    link.reconnects++;
+    printf("%s reconnected after %.2f s\n", link.port.path.c_str(), downNs / 1e9);
+    serialPrint(link.port);
+    return true;
+}
+
+// Watches the tty's directory. Several links share /dev; inotify hands
+// back the same wd for each.
+void hotplugWatchDir(serial_link &link)
+{
+    const size_t slash = link.port.path.rfind('/');
+    const std::string dir = (slash == std::string::npos || 0 == slash) ? "/" : link.port.path.substr(0, slash);
+    link.wd = inotify_add_watch(link.watch->inotifyFd, dir.c_str(), IN_CREATE | IN_ATTRIB | IN_MOVED_TO);
+}
+
+void onHotplugEvent(loop_handler &h, uint32_t /*events*/)
+{
+    hotplug_watch &w = *static_cast<hotplug_watch *>(h.ctx);
+    alignas(struct inotify_event) char buf[4096];
+
+    ssize_t n;
+    while ((n = read(h.fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+            if (0 == ev->len)
+                continue;
+            for (unsigned i = 0; i < w.count; i++) {
+                serial_link &link = *w.links[i];
+                if (!linkWaiting(link) || link.wd != ev->wd)
+                    continue;
+                const size_t slash = link.port.path.rfind('/');
+                if (0 == link.port.path.compare(slash + 1, std::string::npos, ev->name))
+                    hotplugTry(link);
+            }
+        }
+    }
+}
+
+void onHotplugRetry(loop_handler &h, uint32_t /*events*/)
+{
+    hotplug_watch &w = *static_cast<hotplug_watch *>(h.ctx);
+    if (0 == timerAck(h.fd))
+        return;
+    bool waiting = false;
+    for (unsigned i = 0; i < w.count; i++) {
+        serial_link &link = *w.links[i];
+        if (!linkWaiting(link))
+            continue;
+        if (link.wd < 0)
+            hotplugWatchDir(link);   // The directory may exist again by now
+        waiting |= !hotplugTry(link);
+    }
+    if (waiting)
+        timerArm(h.fd, HOTPLUG_RETRY_NS);
+}
+
+// The driver's lost callback: let go, close and wait for the tty.
+void onSerialLost(tourbox_driver &d, void *ctx)
+{
+    serial_link &link = *static_cast<serial_link *>(ctx);
+    driverDetach(d);
+    serialClose(link.port);
+    link.lostNs = monotonicNs();
+    link.disconnects++;
+    printf("%s unplugged, waiting for it to come back\n", link.port.path.c_str());
+    if (link.wd < 0)
+        hotplugWatchDir(link);
+    timerArm(link.watch->retryFd, HOTPLUG_RETRY_NS);
+}
+
+int hotplugInit(hotplug_watch &w, event_loop &loop, latency_stats *latency)
+{
+    w.loop = &loop;
+    w.latency = latency;
+    w.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    w.retryFd = timerOpen();
+    if (w.inotifyFd < 0 || w.retryFd < 0) {
+        perror("hotplug");
+        return -1;
+    }
+    if (loopAdd(loop, w.inotifyFd, EPOLLIN, onHotplugEvent, &w) == nullptr
+     || loopAdd(loop, w.retryFd, EPOLLIN, onHotplugRetry, &w) == nullptr)
+        return -1;
+    return 0;
+}
+
+// From here on, losing the link's tty means waiting for it, not exiting.
+void hotplugAdd(hotplug_watch &w, serial_link &link)
+{
+    if (w.count == w.links.size())
+        return;
+    link.watch = &w;
+    link.driver->lost = onSerialLost;
+    link.driver->lostCtx = &link;
+    w.links[w.count++] = &link;
+}
+
+void hotplugDestroy(hotplug_watch &w)
+{
+    for (int fd : {w.inotifyFd, w.retryFd})
+        if (fd >= 0)
+            close(fd);
+    w.inotifyFd = w.retryFd = -1;
+}
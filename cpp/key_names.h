@@ -0,0 +1,79 @@
+/*
+ * @file key_names.h
+ * @brief KEY_ and BTN_ names for the codes a macro can send. The kernel
+ *        headers only carry numbers, so the names users write in
+ *        tourbox.conf are resolved here, once, at parse time.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <linux/input-event-codes.h>
+
+struct key_name {
+    const char *name;
+    uint16_t code;
+};
+
+#define KEY_NAME(k) {#k, k}
+
+static constexpr key_name keyNames[] = {
+    KEY_NAME(KEY_ESC), KEY_NAME(KEY_1), KEY_NAME(KEY_2), KEY_NAME(KEY_3), KEY_NAME(KEY_4),
+    KEY_NAME(KEY_5), KEY_NAME(KEY_6), KEY_NAME(KEY_7), KEY_NAME(KEY_8), KEY_NAME(KEY_9),
+    KEY_NAME(KEY_0), KEY_NAME(KEY_MINUS), KEY_NAME(KEY_EQUAL), KEY_NAME(KEY_BACKSPACE),
+    KEY_NAME(KEY_TAB), KEY_NAME(KEY_Q), KEY_NAME(KEY_W), KEY_NAME(KEY_E), KEY_NAME(KEY_R),
+    KEY_NAME(KEY_T), KEY_NAME(KEY_Y), KEY_NAME(KEY_U), KEY_NAME(KEY_I), KEY_NAME(KEY_O),
+    KEY_NAME(KEY_P), KEY_NAME(KEY_LEFTBRACE), KEY_NAME(KEY_RIGHTBRACE), KEY_NAME(KEY_ENTER),
+    KEY_NAME(KEY_LEFTCTRL), KEY_NAME(KEY_A), KEY_NAME(KEY_S), KEY_NAME(KEY_D), KEY_NAME(KEY_F),
+    KEY_NAME(KEY_G), KEY_NAME(KEY_H), KEY_NAME(KEY_J), KEY_NAME(KEY_K), KEY_NAME(KEY_L),
+    KEY_NAME(KEY_SEMICOLON), KEY_NAME(KEY_APOSTROPHE), KEY_NAME(KEY_GRAVE),
+    KEY_NAME(KEY_LEFTSHIFT), KEY_NAME(KEY_BACKSLASH), KEY_NAME(KEY_Z), KEY_NAME(KEY_X),
+    KEY_NAME(KEY_C), KEY_NAME(KEY_V), KEY_NAME(KEY_B), KEY_NAME(KEY_N), KEY_NAME(KEY_M),
+    KEY_NAME(KEY_COMMA), KEY_NAME(KEY_DOT), KEY_NAME(KEY_SLASH), KEY_NAME(KEY_RIGHTSHIFT),
+    KEY_NAME(KEY_KPASTERISK), KEY_NAME(KEY_LEFTALT), KEY_NAME(KEY_SPACE), KEY_NAME(KEY_CAPSLOCK),
+    KEY_NAME(KEY_F1), KEY_NAME(KEY_F2), KEY_NAME(KEY_F3), KEY_NAME(KEY_F4), KEY_NAME(KEY_F5),
+    KEY_NAME(KEY_F6), KEY_NAME(KEY_F7), KEY_NAME(KEY_F8), KEY_NAME(KEY_F9), KEY_NAME(KEY_F10),
+    KEY_NAME(KEY_F11), KEY_NAME(KEY_F12), KEY_NAME(KEY_NUMLOCK), KEY_NAME(KEY_SCROLLLOCK),
+    KEY_NAME(KEY_KPMINUS), KEY_NAME(KEY_KPPLUS), KEY_NAME(KEY_KPENTER),
+    KEY_NAME(KEY_RIGHTCTRL), KEY_NAME(KEY_RIGHTALT), KEY_NAME(KEY_SYSRQ),
+    KEY_NAME(KEY_HOME), KEY_NAME(KEY_UP), KEY_NAME(KEY_PAGEUP), KEY_NAME(KEY_LEFT),
+    KEY_NAME(KEY_RIGHT), KEY_NAME(KEY_END), KEY_NAME(KEY_DOWN), KEY_NAME(KEY_PAGEDOWN),
+    KEY_NAME(KEY_INSERT), KEY_NAME(KEY_DELETE), KEY_NAME(KEY_MUTE), KEY_NAME(KEY_VOLUMEDOWN),
+    KEY_NAME(KEY_VOLUMEUP), KEY_NAME(KEY_PAUSE), KEY_NAME(KEY_LEFTMETA), KEY_NAME(KEY_RIGHTMETA),
+    KEY_NAME(KEY_COMPOSE), KEY_NAME(KEY_UNDO), KEY_NAME(KEY_REDO), KEY_NAME(KEY_COPY),
+    KEY_NAME(KEY_PASTE), KEY_NAME(KEY_CUT), KEY_NAME(KEY_FIND), KEY_NAME(KEY_CALC),
+    KEY_NAME(KEY_BACK), KEY_NAME(KEY_FORWARD), KEY_NAME(KEY_REFRESH), KEY_NAME(KEY_ZOOMIN),
+    KEY_NAME(KEY_ZOOMOUT), KEY_NAME(KEY_PLAYPAUSE), KEY_NAME(KEY_NEXTSONG),
+    KEY_NAME(KEY_PREVIOUSSONG), KEY_NAME(KEY_STOPCD), KEY_NAME(KEY_BRIGHTNESSUP),
+    KEY_NAME(KEY_BRIGHTNESSDOWN), KEY_NAME(KEY_MICMUTE),
+    KEY_NAME(KEY_CAMERA_ACCESS_ENABLE), KEY_NAME(KEY_CAMERA_ACCESS_DISABLE),
+    KEY_NAME(BTN_LEFT), KEY_NAME(BTN_RIGHT), KEY_NAME(BTN_MIDDLE),
+};
+
+// Code for a KEY_/BTN_ name, or a plain number for anything not listed.
+// Returns 0 (KEY_RESERVED) if neither.
+uint16_t keyCodeByName(const char *name)
+{
+    for (const auto &k : keyNames)
+        if (0 == strcmp(name, k.name))
+            return k.code;
+    char *end;
+    const long code = strtol(name, &end, 0);
+    return (*end == '\0' && code > 0 && code < KEY_CNT) ? code : 0;
+}
+
+// The KEY_/BTN_ name for a code, or nullptr if it has none.
+const char *keyNameByCode(uint16_t code)
+{
+    for (const auto &k : keyNames)
+        if (code == k.code)
+            return k.name;
+    return nullptr;
+}
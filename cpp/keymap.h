@@ -0,0 +1,603 @@
+/*
+ * @file keymap.h
+ * @brief TourBox scan codes, the default key mapping and the dense
+ *        dispatch table the hot path indexes by raw byte. The device only
+ *        ever sends single-byte codes, so every possible byte has a slot;
+ *        bytes that mean nothing get an explicit no-op slot.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <linux/input-event-codes.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <confuse.h>
+#include "key_names.h"
+
+#ifndef D
+ #define D(x)
+#endif
+
+#define DBL_TOP      0x13
+#define DBL_RING     0x18   // Some keys report double click
+#define DBL_PINKIE   0x1c
+#define DBL_SIDE     0x21
+
+#define NINTENDO_B   0x22    // Two small cyircles near Tourbox logo.
+#define NINTENDO_A   0x23
+#define MOON         0x2a    // Next to tall knob
+#define RING         0x80
+#define SIDE         0x81    // Various small buttons
+#define TOP          0x82
+#define PINKIE       0x83   // On bottom right
+
+#define WHEEL_DOWN    0x09
+#define WHEEL_PRESS   0x0a
+#define WHEEL_UP      0x49  // Large Mouse wheel
+
+#define DPAD_UP      0x90   // Four arrows.
+#define DPAD_DOWN    0x91
+#define DPAD_LEFT    0x92
+#define DPAD_RIGHT   0x93
+
+#define DIAL_PRESS    0x38
+#define DIAL_COUNTER  0x4f
+#define DIAL_CLOCK    0x8f   // Large flat disc
+
+#define KNOB_PRESS    0x37
+#define KNOB_CLOCK    0x44   // Central knob
+#define KNOB_COUNTER  0x84
+
+// One row of the default mapping. Names point at string literals, so the
+// whole table is constexpr and nothing here allocates.
+struct keyfigure {
+  uint8_t code;
+  const char *tstr;
+  int kcode;
+  const char *kstr;
+};
+
+static constexpr std::array<keyfigure, 24> keyfig =
+   {{{NINTENDO_A,      "NINTENDO_A",      KEY_CAMERA_ACCESS_ENABLE,  "KEY_CAMERA_ACCESS_ENABLE"},
+     {NINTENDO_B,      "NINTENDO_B",      KEY_CAMERA_ACCESS_DISABLE, "KEY_CAMERA_ACCESS_DISABLE"},
+     {SIDE,            "SIDE",            KEY_CALC,                  "KEY_CALC"},
+     {TOP,             "TOP",             KEY_REFRESH,               "KEY_REFRESH"},
+     {PINKIE,          "PINKIE",          KEY_FORWARD,               "KEY_FORWARD"},
+     {RING,            "RING",            KEY_BACK,                  "KEY_BACK"},
+     {MOON,            "MOON",            KEY_FORWARD,               "KEY_FORWARD"},
+     {WHEEL_UP,        "WHEEL_UP",        REL_WHEEL,                 "REL_WHEEL"},
+     {WHEEL_DOWN,      "WHEEL_DOWN",      REL_WHEEL,                 "REL_WHEEL"},
+     {WHEEL_PRESS,     "WHEEL_PRESS",     KEY_HOME,                  "KEY_HOME"},
+     {DPAD_UP,         "DPAD_UP",         KEY_UP,                    "KEY_UP"},
+     {DPAD_DOWN,       "DPAD_DOWN",       KEY_DOWN,                  "KEY_DOWN"},
+     {DPAD_LEFT,       "DPAD_LEFT",       KEY_LEFT,                  "KEY_LEFT"},
+     {DPAD_RIGHT,      "DPAD_RIGHT",      KEY_RIGHT,                 "KEY_RIGHT"},
+     {DIAL_CLOCK,      "DIAL_CLOCK",      KEY_BRIGHTNESSUP,          "KEY_BRIGHTNESSUP"},
+     {DIAL_COUNTER,    "DIAL_COUNTER",    KEY_BRIGHTNESSDOWN,        "KEY_BRIGHTNESSDOWN"},
+     {DIAL_PRESS,      "DIAL_PRESS",      KEY_MICMUTE,               "KEY_MICMUTE"},
+     {KNOB_CLOCK,      "KNOB_CLOCK",      KEY_VOLUMEUP,              "KEY_VOLUMEUP"},
+     {KNOB_COUNTER,    "KNOB_COUNTER",    KEY_VOLUMEDOWN,            "KEY_VOLUMEDOWN"},
+     {KNOB_PRESS,      "KNOB_PRESS",      KEY_PLAYPAUSE,             "KEY_PLAYPAUSE"},
+     {DBL_RING,        "DBL_RING",        KEY_CAMERA,                "KEY_CAMERA"},
+     {DBL_PINKIE,      "DBL_PINKIE",      KEY_ALL_APPLICATIONS,      "KEY_ALL_APPLICATIONS"},
+     {DBL_SIDE,        "DBL_SIDE",        KEY_SLEEP,                 "KEY_SLEEP"},
+     {DBL_TOP,         "DBL_TOP",         KEY_SCREENLOCK,            "KEY_SCREENLOCK"}}};
+
+/* === Dispatch table === */
+
+enum action_kind : uint8_t {
+    ACTION_NONE = 0,   // Unknown byte: explicit no-op
+    ACTION_KEY,        // EV_KEY tap of `code`
+    ACTION_WHEEL,      // EV_REL `code` by `rel`
+    ACTION_LAYER,      // Layer modifier: `code` is the layer, `rel` its layer_mode
+};
+
+#define KEYMAP_MAX_LAYERS 8   // The base table plus seven
+
+enum layer_mode : uint8_t {
+    LAYER_HOLD = 0,       // Active while the button is held
+    LAYER_TOGGLE,         // Each press switches it on or off
+    LAYER_ONESHOT,        // Applies to the next press only
+};
+
+enum action_flags : uint8_t {
+    ACTION_HOLD = 0x01,   // Sends a release byte, so down/up follow the finger
+};
+
+// Compact POD record per raw byte. Anything string shaped lives in
+// keymap::execs or keyfig and is only referenced by index.
+struct key_action {
+    uint8_t kind = ACTION_NONE;
+    uint8_t figure = 0;   // Index into keyfig, for names in logs
+    uint8_t flags = 0;    // action_flags
+    uint16_t code = 0;    // EV_KEY code, or REL_* axis for ACTION_WHEEL
+    int32_t rel = 0;      // Key down value / wheel delta, sign included
+    uint32_t exec = 0;    // 1-based index into keymap::execs, 0 = none
+    uint32_t macro = 0;   // 1-based index of the first step in keymap::macroSteps
+};
+static_assert(std::is_trivially_copyable_v<key_action>);
+
+// Commands and macros run on press and stand in for the key's own report.
+inline bool isScripted(const key_action &a) { return a.exec || a.macro; }
+
+#define MACRO_MAX_STEPS 32
+
+enum macro_op : uint8_t {
+    MACRO_END = 0,
+    MACRO_DOWN,           // +KEY_X   press and keep holding
+    MACRO_UP,             // -KEY_X   release
+    MACRO_TAP,            // KEY_X    press and release
+    MACRO_WAIT,           // 50ms     pause without blocking the loop
+};
+
+struct macro_step {
+    uint8_t op = MACRO_END;
+    uint16_t code = 0;    // EV_KEY code for DOWN/UP/TAP
+    uint32_t ms = 0;      // WAIT only
+};
+static_assert(std::is_trivially_copyable_v<macro_step>);
+
+typedef std::array<key_action, 256> action_table;
+
+// Rotary detents send a release byte too, but it only ends the detent.
+constexpr bool isRotary(uint8_t code)
+{
+    return WHEEL_UP == code || WHEEL_DOWN == code
+        || DIAL_CLOCK == code || DIAL_COUNTER == code
+        || KNOB_CLOCK == code || KNOB_COUNTER == code;
+}
+
+constexpr bool isDoubleClick(uint8_t code)
+{
+    return DBL_TOP == code || DBL_RING == code || DBL_PINKIE == code || DBL_SIDE == code;
+}
+
+// Buttons whose press code has the high bit clear get a matching release
+// byte with it set ([22][a2], [2a][aa], ...). The rest can only be tapped.
+constexpr bool canHold(uint8_t code)
+{
+    return !(code & 0x80) && !isRotary(code) && !isDoubleClick(code);
+}
+
+constexpr action_table makeDefaultActions()
+{
+    action_table actions = {};
+    for (uint8_t i = 0; i < keyfig.size(); i++) {
+        key_action &a = actions[keyfig[i].code];
+        a.figure = i;
+        a.code = keyfig[i].kcode;
+        if (WHEEL_UP == keyfig[i].code || WHEEL_DOWN == keyfig[i].code) {
+            a.kind = ACTION_WHEEL;
+            a.rel = (WHEEL_DOWN == keyfig[i].code) ? -1 : 1;
+        } else {
+            a.kind = ACTION_KEY;
+            a.rel = 1;
+            if (canHold(keyfig[i].code))
+                a.flags |= ACTION_HOLD;
+        }
+    }
+    return actions;
+}
+
+static constexpr action_table defaultActions = makeDefaultActions();
+
+// Velocity curve for the wheel, dial and knob (see rotary.h). Rates are in
+// detents per second; below `threshold` every detent is a single step.
+struct accel_curve {
+    bool enabled = false;
+    double threshold = 6.0;
+    double gain = 0.25;
+    double exponent = 1.5;
+    double max = 12.0;        // Upper bound on steps per detent
+    double precision = 0.25;  // Steps per detent while the precision button is held
+    uint8_t precisionKey = 0; // Raw code of the precision modifier, 0 = none
+    uint64_t coalesceNs = 0;  // Merge detents into one report per this long, 0 = off
+    bool coalesceFrames = false; // ...on a fixed frame grid rather than from the last report
+};
+
+// How the tty is set up (see serial_port.h). The defaults suit cdc-acm:
+// VMIN=1 with O_NONBLOCK makes an empty read EAGAIN, and any byte that
+// arrives is handed over at once, with no VTIME batching.
+struct serial_options {
+    uint32_t baud = 115200;   // Any rate: ones without a Bnnn constant go through termios2
+    uint8_t vmin = 1;
+    uint8_t vtime = 0;        // Tenths of a second
+    bool lowLatency = true;   // ASYNC_LOW_LATENCY, where the tty driver keeps it
+};
+
+// One `device` section: a TourBox on its own tty, with its own virtual
+// device, optionally reading a different config file's mapping.
+struct device_config {
+    std::string name;      // Section title, appended to the virtual device's name
+    std::string tty;       // As written: "ACM0" or a full path
+    std::string profile;   // Config file for the mapping, "" = this one
+};
+
+#define KEYMAP_MAX_DEVICES 8
+
+struct keymap {
+    action_table actions = defaultActions;
+    accel_curve accel;
+    serial_options serial;
+    bool hiresScroll = true;          // REL_WHEEL_HI_RES alongside REL_WHEEL
+    std::vector<std::string> execs;   // Interned exec strings, off the hot path
+    std::vector<macro_step> macroSteps; // Every macro back to back, each ending in MACRO_END
+    std::vector<action_table> layers; // Layers 1.., each a full copy of the base plus its overrides
+    std::vector<device_config> devices; // Only read from the main config, at startup
+};
+
+// Dispatch table for a layer. A layer the current keymap does not have
+// (it was reloaded away) falls back to the base table.
+inline const action_table &layerTable(const keymap &map, uint8_t layer)
+{
+    return (layer && layer <= map.layers.size()) ? map.layers[layer - 1] : map.actions;
+}
+
+// The table the hot path reads. It is only ever replaced whole, with one
+// atomic pointer swap (see config_reload.h), so readers never lock. Each
+// profile is one slot that any number of devices read; activeKeymap is
+// the main config's.
+typedef std::atomic<const keymap *> keymap_slot;
+static const keymap defaultKeymap;
+static keymap_slot activeKeymap{&defaultKeymap};
+
+inline const keymap &currentKeymap(const keymap_slot &slot = activeKeymap)
+{
+    return *slot.load(std::memory_order_acquire);
+}
+
+// Publishes a new table and hands back the old one. Only the thread that
+// reads the table may retire what this returns.
+const keymap *swapKeymap(const keymap *fresh, keymap_slot &slot = activeKeymap)
+{
+    return slot.exchange(fresh, std::memory_order_acq_rel);
+}
+
+void retireKeymap(const keymap *old)
+{
+    if (old != &defaultKeymap)
+        delete old;
+}
+
+// Which hold-capable codes are down right now, as seen from the device,
+// and the key each one pressed, so the release matches even if the layer
+// changed in between.
+struct key_state {
+    std::bitset<256> held;
+    std::array<uint16_t, 256> sent = {};
+};
+
+// Older configs put key names like "KEY_HOME" in exec, back when it was
+// never run. Those are not commands, so they stay inert.
+bool isKeyName(const char *exec)
+{
+    if (strncmp(exec, "KEY_", 4) != 0 && strncmp(exec, "BTN_", 4) != 0)
+        return false;
+    for (const char *p = exec; *p; p++)
+        if (!isupper((unsigned char)*p) && !isdigit((unsigned char)*p) && *p != '_')
+            return false;
+    return true;
+}
+
+// Stores an exec string once and returns its 1-based handle.
+uint32_t internExec(keymap &map, const char *exec)
+{
+    if (exec == nullptr || exec[0] == '\0' || isKeyName(exec))
+        return 0;
+    for (size_t i = 0; i < map.execs.size(); i++)
+        if (map.execs[i] == exec)
+            return i + 1;
+    map.execs.emplace_back(exec);
+    return map.execs.size();
+}
+
+// Compiles a macro such as "+KEY_LEFTCTRL KEY_C -KEY_LEFTCTRL 50ms KEY_V"
+// into macroSteps and returns its 1-based handle, 0 for none or an error.
+uint32_t parseMacro(keymap &map, const char *text, const char *owner)
+{
+    if (text == nullptr || text[0] == '\0')
+        return 0;
+    std::vector<macro_step> steps;
+    std::string token;
+    for (const char *p = text; ; p++) {
+        if (*p != '\0' && !isspace((unsigned char)*p)) {
+            token += *p;
+            continue;
+        }
+        if (!token.empty()) {
+            macro_step step;
+            char *end;
+            const unsigned long ms = strtoul(token.c_str(), &end, 10);
+            if (end != token.c_str() && 0 == strcmp(end, "ms")) {
+                step.op = MACRO_WAIT;
+                step.ms = ms;
+            } else {
+                const char sign = token[0];
+                step.op = ('+' == sign) ? MACRO_DOWN : ('-' == sign) ? MACRO_UP : MACRO_TAP;
+                step.code = keyCodeByName(token.c_str() + (MACRO_TAP != step.op));
+                if (0 == step.code) {
+                    printf("warning: macro for %s: unknown key '%s', ignoring the macro\n", owner, token.c_str());
+                    return 0;
+                }
+            }
+            steps.push_back(step);
+            token.clear();
+        }
+        if (*p == '\0')
+            break;
+    }
+    if (steps.empty() || steps.size() >= MACRO_MAX_STEPS) {
+        printf("warning: macro for %s needs 1 to %i steps, ignoring it\n", owner, MACRO_MAX_STEPS - 1);
+        return 0;
+    }
+    const uint32_t first = map.macroSteps.size() + 1;
+    map.macroSteps.insert(map.macroSteps.end(), steps.begin(), steps.end());
+    map.macroSteps.emplace_back();
+    return first;
+}
+
+// Raw code for a keyfig title such as "MOON", or 0 if there is none.
+uint8_t codeByName(const char *name)
+{
+    if (name == nullptr)
+        return 0;
+    for (const auto &figure : keyfig)
+        if (0 == strcmp(figure.tstr, name))
+            return figure.code;
+    return 0;
+}
+
+// The keyfig title for a raw code, or nullptr if there is none.
+const char *nameByCode(uint8_t code)
+{
+    for (const auto &figure : keyfig)
+        if (code == figure.code)
+            return figure.tstr;
+    return nullptr;
+}
+
+const char *actionName(const key_action &a)
+{
+    return (ACTION_NONE == a.kind) ? "NONE" : keyfig[a.figure].tstr;
+}
+
+void printKeymap(const keymap &map)
+{
+  for (const auto& figure : keyfig) {
+            const key_action &action = map.actions[figure.code];
+            std::cout << "Key: " << (int )figure.code
+                  << " Value1: " << figure.tstr
+                  << " Label: " << action.code
+                  << " Description: " << figure.kstr
+                  << " Rel: " << action.rel
+                  << " Code: " << (action.exec ? map.execs[action.exec - 1] : "")
+                  << " Macro: " << (action.macro ? "yes" : "")
+                  << std::endl;
+  }
+}
+
+// One key section, into the base table or a layer's. Modifiers cannot be
+// overridden: their release has to reach the same modifier.
+void applyKeySection(cfg_t *sec, keymap &map, action_table &actions, std::bitset<256> &seen, const char *filename)
+{
+    const uint8_t code = codeByName(cfg_title(sec));
+    if (0 == code) {
+      printf("warning: unknown key '%s' in %s\n", cfg_title(sec), filename);
+      return;
+    }
+    if (cfg_true != cfg_getbool(sec, "flag") || seen.test(code) || ACTION_LAYER == actions[code].kind)
+      return;
+    seen.set(code);
+    key_action &action = actions[code];
+    const int rel = (int )cfg_getint(sec, "rel");
+    action.rel = (WHEEL_DOWN == code) ? -rel : rel;
+    action.exec = internExec(map, cfg_getstr(sec, "exec"));
+    action.macro = parseMacro(map, cfg_getstr(sec, "macro"), cfg_title(sec));
+    const char *name = cfg_getstr(sec, "code");
+    if (name != nullptr && name[0] != '\0' && ACTION_WHEEL != action.kind) {
+      const uint16_t kcode = keyCodeByName(name);
+      if (kcode)
+        action.code = kcode;
+      else
+        printf("warning: %s: unknown key code '%s'\n", cfg_title(sec), name);
+    }
+}
+
+std::string parse_conf(const char *filename, keymap &map)
+{
+  cfg_opt_t key[] = {
+    CFG_BOOL("flag", cfg_false, CFGT_NONE),
+    CFG_INT("rel", 1, CFGT_NONE),
+    CFG_STR("exec", 0, CFGT_NONE),
+    CFG_STR("macro", 0, CFGT_NONE),
+    CFG_STR("code", 0, CFGT_NONE),
+    CFG_END()
+  };
+
+  cfg_opt_t layer[] = {
+    CFG_STR("modifier", "", CFGF_NONE),
+    CFG_STR("mode", "hold", CFGF_NONE),
+    CFG_SEC("key", key, CFGF_MULTI | CFGF_TITLE),
+    CFG_END()
+  };
+
+  cfg_opt_t accel[] = {
+    CFG_BOOL("enabled", cfg_false, CFGF_NONE),
+    CFG_FLOAT("threshold", 6.0, CFGF_NONE),
+    CFG_FLOAT("gain", 0.25, CFGF_NONE),
+    CFG_FLOAT("exponent", 1.5, CFGF_NONE),
+    CFG_FLOAT("max", 12.0, CFGF_NONE),
+    CFG_FLOAT("precision", 0.25, CFGF_NONE),
+    CFG_STR("precision_key", "", CFGF_NONE),
+    CFG_FLOAT("coalesce_ms", 0.0, CFGF_NONE),
+    CFG_INT("coalesce_hz", 0, CFGF_NONE),
+    CFG_END()
+  };
+
+  cfg_opt_t serial[] = {
+    CFG_INT("baud", 115200, CFGF_NONE),
+    CFG_INT("vmin", 1, CFGF_NONE),
+    CFG_INT("vtime", 0, CFGF_NONE),
+    CFG_BOOL("low_latency", cfg_true, CFGF_NONE),
+    CFG_END()
+  };
+
+  cfg_opt_t device[] = {
+    CFG_STR("tty", "", CFGF_NONE),
+    CFG_STR("profile", "", CFGF_NONE),
+    CFG_END()
+  };
+
+  cfg_opt_t opts[] = {
+    CFG_FLOAT("VERSION", 0.0, CFGF_NONE),
+    CFG_STR("tty", "ACM1", CFGF_NONE),
+    CFG_SEC("device", device, CFGF_MULTI | CFGF_TITLE),
+    CFG_BOOL("hires_scroll", cfg_true, CFGF_NONE),
+    CFG_SEC("key", key, CFGF_MULTI | CFGF_TITLE),
+    CFG_SEC("accel", accel, CFGF_NONE),
+    CFG_SEC("serial", serial, CFGF_NONE),
+    CFG_SEC("layer", layer, CFGF_MULTI | CFGF_TITLE),
+    CFG_END()
+  };
+
+  static std::mutex parseLock;   // libconfuse's lexer is not reentrant, and a
+  std::lock_guard<std::mutex> lock(parseLock);   // reload and a profile switch can overlap
+  cfg_t *cfg = cfg_init(opts, CFGF_NONE);
+  switch (cfg_parse(cfg, filename)) {
+	  case CFG_FILE_ERROR:
+	    printf("warning: configuration file '%s' could not be found: %s\n", filename, strerror(errno));
+	    cfg_free(cfg);
+	    return "0";
+	  case CFG_PARSE_ERROR:
+	    printf("warning: configuration file '%s' read error:  %s\n", filename, strerror(errno));
+	    cfg_free(cfg);
+	    return "0";
+    case CFG_SUCCESS:
+	    break;
+  }
+
+  // One pass over the sections; each title is matched against the 24
+  // known names. The first enabled section for a key wins.
+  std::bitset<256> seen;
+  for (unsigned int i = 0; i < cfg_size(cfg, "key"); i++)
+    applyKeySection(cfg_getnsec(cfg, "key", i), map, map.actions, seen, filename);
+
+  // Modifiers go into the base table first, so every layer copies them
+  // and the release is seen whichever layer is up by then.
+  const unsigned layerCount = cfg_size(cfg, "layer");
+  for (unsigned int i = 0; i < layerCount && map.layers.size() + 1 < KEYMAP_MAX_LAYERS; i++) {
+    cfg_t *sec = cfg_getnsec(cfg, "layer", i);
+    const uint8_t modifier = codeByName(cfg_getstr(sec, "modifier"));
+    const char *mode = cfg_getstr(sec, "mode");
+    const layer_mode lm = (0 == strcmp(mode, "toggle")) ? LAYER_TOGGLE
+                        : (0 == strcmp(mode, "oneshot")) ? LAYER_ONESHOT : LAYER_HOLD;
+    if (0 == modifier || isRotary(modifier) || ACTION_LAYER == map.actions[modifier].kind) {
+      printf("warning: layer %s needs a free button as its modifier, skipping it\n", cfg_title(sec));
+      continue;
+    }
+    if (LAYER_HOLD == lm && !canHold(modifier)) {
+      printf("warning: layer %s: %s never reports a release, use mode=\"toggle\" or \"oneshot\"\n",
+             cfg_title(sec), cfg_getstr(sec, "modifier"));
+      continue;
+    }
+    key_action &action = map.actions[modifier];
+    action = key_action();
+    action.kind = ACTION_LAYER;
+    action.figure = defaultActions[modifier].figure;
+    action.code = map.layers.size() + 1;
+    action.rel = lm;
+    map.layers.emplace_back();
+  }
+  for (auto &layer : map.layers)
+    layer = map.actions;
+  for (unsigned int i = 0, l = 0; i < layerCount && l < map.layers.size(); i++) {
+    cfg_t *sec = cfg_getnsec(cfg, "layer", i);
+    const uint8_t modifier = codeByName(cfg_getstr(sec, "modifier"));
+    if (0 == modifier || ACTION_LAYER != map.actions[modifier].kind || map.actions[modifier].code != l + 1)
+      continue;                      // Skipped above
+    std::bitset<256> layerSeen;
+    for (unsigned int k = 0; k < cfg_size(sec, "key"); k++)
+      applyKeySection(cfg_getnsec(sec, "key", k), map, map.layers[l], layerSeen, filename);
+    l++;
+  }
+
+  map.hiresScroll = (cfg_true == cfg_getbool(cfg, "hires_scroll"));
+
+  cfg_t *acc = cfg_getsec(cfg, "accel");
+  if (acc != nullptr) {
+    map.accel.enabled = (cfg_true == cfg_getbool(acc, "enabled"));
+    map.accel.threshold = cfg_getfloat(acc, "threshold");
+    map.accel.gain = cfg_getfloat(acc, "gain");
+    map.accel.exponent = cfg_getfloat(acc, "exponent");
+    map.accel.max = cfg_getfloat(acc, "max");
+    map.accel.precision = cfg_getfloat(acc, "precision");
+    map.accel.precisionKey = codeByName(cfg_getstr(acc, "precision_key"));
+    if (map.accel.precisionKey && !canHold(map.accel.precisionKey)) {
+      printf("warning: precision_key %s never reports a release, ignoring it\n", cfg_getstr(acc, "precision_key"));
+      map.accel.precisionKey = 0;
+    }
+    if (map.accel.precisionKey && ACTION_LAYER == map.actions[map.accel.precisionKey].kind) {
+      printf("warning: precision_key %s is a layer modifier, ignoring it\n", cfg_getstr(acc, "precision_key"));
+      map.accel.precisionKey = 0;
+    }
+    const double coalesceMs = cfg_getfloat(acc, "coalesce_ms");
+    const long coalesceHz = cfg_getint(acc, "coalesce_hz");
+    if (coalesceHz > 0) {             // A frame cadence wins over a plain window
+      map.accel.coalesceNs = 1000000000ULL / coalesceHz;
+      map.accel.coalesceFrames = true;
+    }
+    else if (coalesceMs > 0.0)
+      map.accel.coalesceNs = (uint64_t)(coalesceMs * 1e6);
+  }
+
+  cfg_t *ser = cfg_getsec(cfg, "serial");
+  if (ser != nullptr) {
+    const long baud = cfg_getint(ser, "baud");
+    const long vmin = cfg_getint(ser, "vmin");
+    const long vtime = cfg_getint(ser, "vtime");
+    if (baud > 0)
+      map.serial.baud = baud;
+    else
+      printf("warning: serial baud %li is not a rate, using %u\n", baud, map.serial.baud);
+    if (vmin >= 0 && vmin <= 255 && vtime >= 0 && vtime <= 255) {
+      map.serial.vmin = vmin;
+      map.serial.vtime = vtime;
+    }
+    else
+      printf("warning: serial vmin and vtime go from 0 to 255, using %u and %u\n", map.serial.vmin, map.serial.vtime);
+    map.serial.lowLatency = (cfg_true == cfg_getbool(ser, "low_latency"));
+  }
+
+  for (unsigned int i = 0; i < cfg_size(cfg, "device"); i++) {
+    cfg_t *sec = cfg_getnsec(cfg, "device", i);
+    if ('\0' == cfg_getstr(sec, "tty")[0]) {
+      printf("warning: device %s has no tty, skipping it\n", cfg_title(sec));
+      continue;
+    }
+    if (map.devices.size() == KEYMAP_MAX_DEVICES) {
+      printf("warning: only %u devices are supported, skipping %s\n", KEYMAP_MAX_DEVICES, cfg_title(sec));
+      continue;
+    }
+    map.devices.push_back({cfg_title(sec), cfg_getstr(sec, "tty"), cfg_getstr(sec, "profile")});
+  }
+
+  D(printKeymap(map);)
+  const std::string tty = cfg_getstr(cfg, "tty");
+  cfg_free(cfg);    // Reloads parse on their own thread, nothing may outlive this
+  return tty;
+}
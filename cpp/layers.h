@@ -0,0 +1,70 @@
+/*
+ * @file layers.h
+ * @brief Which keymap layer is up. Modifier buttons (ACTION_LAYER) hold,
+ *        toggle or one-shot a layer; the effective layer is worked out
+ *        only when one of them changes, so the hot path just indexes
+ *        keymap::layers with it.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include "keymap.h"
+
+struct layer_state {
+    std::bitset<KEYMAP_MAX_LAYERS> held;   // Hold modifiers that are down
+    uint8_t toggled = 0;                   // 0 = none
+    uint8_t oneshot = 0;                   // Armed for the next press, 0 = none
+    uint8_t active = 0;                    // What lookups use
+    uint64_t switches = 0;
+};
+
+// One-shot beats held beats toggled; among held layers the highest wins.
+void layerResolve(layer_state &ls)
+{
+    uint8_t active = ls.toggled;
+    for (int l = KEYMAP_MAX_LAYERS - 1; l > 0; l--)
+        if (ls.held.test(l)) {
+            active = l;
+            break;
+        }
+    if (ls.oneshot)
+        active = ls.oneshot;
+    if (active != ls.active)
+        ls.switches++;
+    ls.active = active;
+}
+
+// A modifier byte. Toggle and one-shot act on the press only.
+void layerModifier(layer_state &ls, const key_action &action, bool pressed)
+{
+    const uint8_t layer = action.code & (KEYMAP_MAX_LAYERS - 1);
+    switch (action.rel) {
+      case LAYER_HOLD:
+        ls.held.set(layer, pressed);
+        break;
+      case LAYER_TOGGLE:
+        if (pressed)
+          ls.toggled = (ls.toggled == layer) ? 0 : layer;
+        break;
+      case LAYER_ONESHOT:
+        if (pressed)
+          ls.oneshot = (ls.oneshot == layer) ? 0 : layer;
+        break;
+    }
+    layerResolve(ls);
+}
+
+// Called once a press has been looked up on a one-shot layer.
+inline void layerConsume(layer_state &ls)
+{
+    if (ls.oneshot) {
+        ls.oneshot = 0;
+        layerResolve(ls);
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ * @file macro.h
+ * @brief Runs macro actions: key downs, ups, taps and waits from
+ *        tourbox.conf. Steps up to the first wait go out straight away
+ *        with the rest of the decoded burst; each wait parks the macro on
+ *        the timer wheel, so the knob and dial keep working while a long
+ *        macro plays out. Any number of macros can run side by side, each
+ *        costing one wheel timer.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include "keymap.h"
+#include "timer_wheel.h"
+#include "uinput_helper.h"
+
+#define MACRO_MAX_RUNS 16
+
+struct macro_engine;
+
+struct macro_run {
+    wheel_timer timer;
+    macro_engine *engine = nullptr;
+    std::array<macro_step, MACRO_MAX_STEPS> steps;   // Copied: a reload may free the keymap
+    uint8_t pc = 0;
+    bool active = false;
+    std::bitset<KEY_CNT> down;                       // Released if the run is cut short
+};
+
+struct macro_engine {
+    timer_wheel *wheel = nullptr;
+    event_batch *events = nullptr;
+    std::array<macro_run, MACRO_MAX_RUNS> runs;
+    uint64_t started = 0;
+    uint64_t completed = 0;
+    uint64_t dropped = 0;    // No free run, or no wheel to wait on
+};
+
+// Queues steps until a wait or the end. The caller flushes.
+void macroAdvance(macro_run &run)
+{
+    event_batch &events = *run.engine->events;
+    for (;;) {
+        const macro_step &step = run.steps[run.pc++];
+        switch (step.op) {
+          case MACRO_DOWN:
+            emit(events, EV_KEY, step.code, 1);
+            emit(events, EV_SYN, SYN_REPORT, 0);
+            run.down.set(step.code);
+            break;
+          case MACRO_UP:
+            emit(events, EV_KEY, step.code, 0);
+            emit(events, EV_SYN, SYN_REPORT, 0);
+            run.down.reset(step.code);
+            break;
+          case MACRO_TAP:
+            emit(events, EV_KEY, step.code, 1);
+            emit(events, EV_SYN, SYN_REPORT, 0);
+            emit(events, EV_KEY, step.code, 0);
+            emit(events, EV_SYN, SYN_REPORT, 0);
+            break;
+          case MACRO_WAIT:
+            wheelAdd(*run.engine->wheel, run.timer, step.ms);
+            return;
+          case MACRO_END:
+            for (unsigned code = 0; code < KEY_CNT; code++)   // Nothing stays stuck down
+              if (run.down.test(code)) {
+                emit(events, EV_KEY, code, 0);
+                emit(events, EV_SYN, SYN_REPORT, 0);
+              }
+            run.down.reset();
+            run.active = false;
+            run.engine->completed++;
+            return;
+        }
+    }
+}
+
+void onMacroTimer(wheel_timer & /*t*/, void *ctx)
+{
+    macro_run &run = *static_cast<macro_run *>(ctx);
+    event_batch &events = *run.engine->events;
+    events.stampNs = 0;                  // Not tied to a serial read
+    macroAdvance(run);
+    flushEvents(events);
+}
+
+void macroInit(macro_engine &e, timer_wheel *wheel, event_batch *events)
+{
+    e.wheel = wheel;
+    e.events = events;
+    for (auto &run : e.runs) {
+        run.engine = &e;
+        run.timer.cb = onMacroTimer;
+        run.timer.ctx = &run;
+    }
+}
+
+// Starts the macro whose first step is map.macroSteps[first - 1].
+bool macroStart(macro_engine &e, const keymap &map, uint32_t first)
+{
+    macro_run *run = nullptr;
+    for (auto &r : e.runs)
+        if (!r.active) {
+            run = &r;
+            break;
+        }
+    if (run == nullptr || e.wheel == nullptr || e.events == nullptr) {
+        e.dropped++;
+        return false;
+    }
+    for (unsigned i = 0; i < MACRO_MAX_STEPS; i++) {
+        run->steps[i] = map.macroSteps[first - 1 + i];
+        if (MACRO_END == run->steps[i].op)
+            break;
+    }
+    run->steps[MACRO_MAX_STEPS - 1] = macro_step();   // parseMacro() keeps them shorter
+    run->pc = 0;
+    run->active = true;
+    e.started++;
+    macroAdvance(*run);
+    return true;
+}
+
+// Stops every running macro and lets go of whatever they hold down.
+void macroCancelAll(macro_engine &e)
+{
+    for (auto &run : e.runs) {
+        if (!run.active)
+            continue;
+        if (e.wheel != nullptr)
+            wheelCancel(*e.wheel, run.timer);
+        run.steps[run.pc] = macro_step();
+        macroAdvance(run);
+    }
+    if (e.events != nullptr)
+        flushEvents(*e.events);
+}
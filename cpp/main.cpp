@@ -19,28 +19,333 @@
 #include <signal.h>
 #include <stdint.h>
 #include <string>
-#include <termios.h>
 #include <unistd.h>
+#include <vector>
 #include <confuse.h>
+#include <sys/signalfd.h>
 // #include <FL/Fl.H>
 // #include <FL/Fl_Window.H>
 // #include <FL/Fl_Box.H>
 // Local
 #include "uinput_helper.h"
-// Remember, can't pass data to signals
-static int gUinputFileDescriptor = 0;
+#include "event_loop.h"
+#include "driver.h"
+#include "config_cache.h"
+#include "config_reload.h"
+#include "latency.h"
+#include "trace.h"
+#include "exec_spawner.h"
+#include "timer_wheel.h"
+#include "control_socket.h"
+#include "hotplug.h"
+#include "serial_port.h"
+#include "realtime.h"
+#include "serial_reader.h"
 
-void sigint_handler(sig_atomic_t s)
+// One TourBox: its tty, decoder state and virtual device. Devices never
+// move once set up; their handlers point into them.
+struct tourbox_device {
+    std::string name;            // The config's device section, "" for the tty key
+    serial_link link;            // The tty, which may come and go
+    serial_reader reader;        // --threads only
+    output_sink sink;
+    tourbox_driver driver;
+};
+
+// A config file other than tourbox.conf that some device maps through.
+// Devices naming the same file share its tables and its reloader.
+struct tourbox_profile {
+    std::string path;
+    keymap_slot map{&defaultKeymap};
+    config_reloader reloader;
+};
+
+static event_loop gLoop;
+static std::array<tourbox_device, KEYMAP_MAX_DEVICES> gDevices;
+static unsigned gDeviceCount = 0;
+static std::array<tourbox_profile, KEYMAP_MAX_DEVICES> gProfiles;
+static unsigned gProfileCount = 0;
+static config_reloader gReloader;   // tourbox.conf, feeding activeKeymap
+static latency_stats gLatency;
+static exec_spawner gSpawner;
+static timer_wheel gWheel;       // Macro waits
+static control_server gControl;
+static hotplug_watch gHotplug;   // Unplugged ttys, until they come back
+static trace_file gRecord;       // --record: raw bytes as they are read
+
+// --replay: a trace fed through the same path, paced by a timerfd
+struct replay_state {
+    trace_file trace;
+    int timerFd = -1;
+    double speed = 1.0;          // 0 = as fast as possible
+    uint64_t startNs = 0;
+    std::array<uint8_t, TRACE_CHUNK_MAX> chunk;
+    int len = 0;
+    uint64_t offsetNs = 0;
+    bool done = false;
+};
+static replay_state gReplay;
+
+// Counters for every device, the spawner and the latency histograms.
+void printStats(void)
 {
-    const int error = gUinputFileDescriptor;
-    std::cout << "\n\nNuked.\n\n" << s << std::endl;
-    destroyUinput(gUinputFileDescriptor);
-    exit(error);
+    for (unsigned i = 0; i < gDeviceCount; i++)
+    {
+        if (gDeviceCount > 1)
+            printf("%s:\n", gDevices[i].name.c_str());
+        driverPrintStats(gDevices[i].driver);
+        if (gDevices[i].link.disconnects)
+            printf("tty: %llu disconnects, %llu reconnects\n",
+                   (unsigned long long)gDevices[i].link.disconnects, (unsigned long long)gDevices[i].link.reconnects);
+    }
+    spawnerPrintStats(gSpawner);
+    if (LOOP_URING == gLoop.backend)
+        printf("io_uring: %llu waits, %llu writes queued (%llu more merged into them), %llu held back, %llu written directly, %llu failed\n",
+               (unsigned long long)gLoop.waits, (unsigned long long)gLoop.writesQueued,
+               (unsigned long long)gLoop.writesMerged, (unsigned long long)gLoop.writesDeferred,
+               (unsigned long long)gLoop.writesDirect, (unsigned long long)gLoop.writeErrors);
+    latencyDump(gLatency, stdout);
+    fflush(stdout);
+}
+
+// Signals arrive through a signalfd, so this runs from the loop and not
+// from signal context -- cleanup happens after loopRun() returns, which
+// releases held keys and drains the batches before the devices go.
+void onSignal(loop_handler &h, uint32_t /*events*/)
+{
+    struct signalfd_siginfo si;
+    while (read(h.fd, &si, sizeof(si)) == sizeof(si)) {
+        switch (si.ssi_signo) {
+          case SIGUSR1:                  // Stats on demand
+            printStats();
+            break;
+          case SIGHUP:                   // Re-read every config file now
+            if (gReloader.readyFd >= 0)
+              reloadKick(gReloader);
+            for (unsigned p = 0; p < gProfileCount; p++)
+              if (gProfiles[p].reloader.readyFd >= 0)
+                reloadKick(gProfiles[p].reloader);
+            break;
+          default:                       // SIGINT, SIGTERM
+            std::cout << "\n\nNuked.\n\n" << si.ssi_signo << std::endl;
+            loopStop(gLoop);
+            break;
+        }
+    }
+}
+
+// Control socket commands, applied on the loop thread between input events.
+// Counters are summed over every device; profile, bind and layer act on
+// tourbox.conf's mapping and the devices that use it.
+void onControl(const control_request &req, control_reply &reply, void * /*ctx*/)
+{
+    switch (req.kind) {
+      case CONTROL_STATS: {
+        const latency_histogram &total = gLatency.stages[STAGE_TOTAL];
+        decoder_stats sum;
+        uint64_t writes = 0, macros = 0, reconnects = 0;
+        for (unsigned i = 0; i < gDeviceCount; i++) {
+          const tourbox_driver &d = gDevices[i].driver;
+          sum.reads += d.stats.reads;
+          sum.bytes += d.stats.bytes;
+          sum.events += d.stats.events;
+          sum.unknown += d.stats.unknown;
+          sum.overflow += d.stats.overflow;
+          writes += d.events.writes;
+          macros += d.macros.started;
+          reconnects += gDevices[i].link.reconnects;
+        }
+        snprintf(reply.text, sizeof(reply.text),
+                 "ok devices=%u reads=%llu bytes=%llu events=%llu unknown=%llu overflow=%llu writes=%llu"
+                 " layer=%u reloads=%llu exec=%llu macros=%llu reconnects=%llu p50_us=%.1f p99_us=%.1f\n",
+                 gDeviceCount, (unsigned long long)sum.reads, (unsigned long long)sum.bytes,
+                 (unsigned long long)sum.events, (unsigned long long)sum.unknown,
+                 (unsigned long long)sum.overflow, (unsigned long long)writes,
+                 gDevices[0].driver.layers.active, (unsigned long long)gReloader.reloads,
+                 (unsigned long long)gSpawner.spawned, (unsigned long long)macros,
+                 (unsigned long long)reconnects,
+                 latencyPercentile(total, 0.50) / 1e3, latencyPercentile(total, 0.99) / 1e3);
+        break;
+      }
+      case CONTROL_RELOAD:
+        if (gReloader.readyFd < 0) {
+          snprintf(reply.text, sizeof(reply.text), "error reloads unavailable\n");
+          break;
+        }
+        reloadKick(gReloader);
+        snprintf(reply.text, sizeof(reply.text), "ok reloading\n");
+        break;
+      case CONTROL_KEYMAP:
+        req.map->hiresScroll = currentKeymap().hiresScroll;   // Fixed when the device was created
+        retireKeymap(swapKeymap(req.map));
+        printf("profile switched to %s\n", req.path);
+        snprintf(reply.text, sizeof(reply.text), "ok profile=%s layers=%zu\n", req.path, currentKeymap().layers.size());
+        break;
+      case CONTROL_BIND: {
+        keymap *fresh = new keymap(currentKeymap());
+        if (req.layer > fresh->layers.size()
+         || ACTION_LAYER == layerTable(*fresh, req.layer)[req.button].kind) {
+          delete fresh;
+          snprintf(reply.text, sizeof(reply.text), "error no such layer, or that button is a modifier\n");
+          break;
+        }
+        key_action &action = (req.layer ? fresh->layers[req.layer - 1] : fresh->actions)[req.button];
+        action.kind = ACTION_KEY;
+        action.code = req.code;
+        action.rel = 1;
+        action.exec = action.macro = 0;
+        retireKeymap(swapKeymap(fresh));
+        const char *key = keyNameByCode(req.code);
+        if (key != nullptr)
+          snprintf(reply.text, sizeof(reply.text), "ok bind %s %s layer=%u\n", nameByCode(req.button), key, req.layer);
+        else
+          snprintf(reply.text, sizeof(reply.text), "ok bind %s %u layer=%u\n", nameByCode(req.button), req.code, req.layer);
+        break;
+      }
+      case CONTROL_LAYER:
+        if (req.layer > currentKeymap().layers.size()) {
+          snprintf(reply.text, sizeof(reply.text), "error no such layer\n");
+          break;
+        }
+        for (unsigned i = 0; i < gDeviceCount; i++) {
+          tourbox_driver &d = gDevices[i].driver;
+          if (d.profile != &activeKeymap)
+            continue;
+          d.layers.toggled = req.layer;
+          layerResolve(d.layers);
+        }
+        snprintf(reply.text, sizeof(reply.text), "ok layer=%u\n", req.layer);
+        break;
+    }
+}
+
+// Loads the next chunk and arms the timer for when it is due. At the end
+// of the trace there is one last wait so pending double clicks resolve.
+void replayArm(void)
+{
+    gReplay.len = traceNext(gReplay.trace, gReplay.offsetNs, gReplay.chunk.data());
+    if (0 == gReplay.len) {
+      gReplay.done = true;
+      timerArm(gReplay.timerFd, 2 * DBL_CLICK_WINDOW_NS);
+      return;
+    }
+    if (gReplay.speed <= 0.0) {
+      timerArm(gReplay.timerFd, 1);
+      return;
+    }
+    const uint64_t dueNs = gReplay.startNs + (uint64_t)(gReplay.offsetNs / gReplay.speed);
+    const uint64_t nowNs = monotonicNs();
+    timerArm(gReplay.timerFd, (dueNs > nowNs) ? dueNs - nowNs : 1);
+}
+
+void onReplay(loop_handler &h, uint32_t /*events*/)
+{
+    if (0 == timerAck(h.fd))
+      return;
+    if (gReplay.done) {
+      loopStop(gLoop);
+      return;
+    }
+    // Paced replay does one chunk per deadline; as-fast-as-possible does a
+    // run of them, then yields so click timers and signals still get a turn.
+    for (int i = 0; i < 256 && gReplay.len > 0; i++) {
+      driverFeed(gDevices[0].driver, gReplay.chunk.data(), gReplay.len);
+      if (gReplay.speed > 0.0)
+        break;
+      gReplay.len = traceNext(gReplay.trace, gReplay.offsetNs, gReplay.chunk.data());
+    }
+    if (gReplay.speed > 0.0 || 0 == gReplay.len)
+      replayArm();
+    else
+      timerArm(gReplay.timerFd, 1);
+}
+
+// Opens a TourBox's tty at startup. Exits on failure, as there is nothing
+// worth serving without every configured device.
+int openSerial(serial_port &port)
+{
+    const std::string &path = port.path;
+    const int fd = serialOpen(port);
+    switch (fd) {
+      case SERIAL_OPEN_FAILED:
+        std::cerr << "Failed to open serial port: " << path << std::endl;
+        std::cerr << "Did you forget to plug in the TourBox?"  << std::endl;
+        exit(fd);
+      case SERIAL_TERMIOS_FAILED:
+        std::cerr << "Failed to set termios settings";
+        exit(2);
+      case SERIAL_FLUSH_FAILED:
+        std::cerr << "Failed to flush termios settings";
+        exit(3);
+    }
+    return fd;
 }
 
+void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--tty PATH] [--sink SINK] [--control PATH] [--realtime PRIO] [--cpu N] [--threads]\n"
+                    "          [--loop epoll|io_uring]\n"
+                    "          [--record FILE | --replay FILE [--speed X]]\n"
+                    "  --tty PATH     serial device to use instead of the config's (first) tty\n"
+                    "  --sink SINK    uinput (default), null, memory or file:PATH\n"
+                    "  --control PATH control socket, default $XDG_RUNTIME_DIR/tourbox.sock, none to disable\n"
+                    "  --realtime PRIO run the loop SCHED_FIFO at PRIO, with its memory locked\n"
+                    "  --cpu N        pin the loop to core N\n"
+                    "  --threads      read each tty on a thread of its own, so slow writes never hold up a read\n"
+                    "  --loop io_uring  keep reads posted and queue uinput writes on an io_uring (Linux 6.1+)\n"
+                    "  --record FILE  log every raw serial byte of the first device with its timestamp\n"
+                    "  --replay FILE  feed a recorded trace instead of the ttys\n"
+                    "  --speed X      replay at X times real time, 0 = as fast as possible\n", argv0);
+}
 
-int main( void/* int argc, char *argv[]*/ )
+int main(int argc, char *argv[])
 {
+    const char *recordPath = nullptr;
+    const char *replayPath = nullptr;
+    const char *ttyPath = nullptr;
+    const char *sinkSpec = "uinput";
+    std::string controlSocket = controlPath();
+    realtime_options realtime;
+    bool threads = false;
+    loop_backend backend = LOOP_EPOLL;
+    for (int i = 1; i < argc; i++) {
+      if (0 == strcmp(argv[i], "--tty") && i + 1 < argc)
+        ttyPath = argv[++i];
+      else if (0 == strcmp(argv[i], "--sink") && i + 1 < argc)
+        sinkSpec = argv[++i];
+      else if (0 == strcmp(argv[i], "--control") && i + 1 < argc)
+        controlSocket = argv[++i];
+      else if (0 == strcmp(argv[i], "--realtime") && i + 1 < argc)
+        realtime.priority = atoi(argv[++i]);
+      else if (0 == strcmp(argv[i], "--cpu") && i + 1 < argc)
+        realtime.cpu = atoi(argv[++i]);
+      else if (0 == strcmp(argv[i], "--threads"))
+        threads = true;
+      else if (0 == strcmp(argv[i], "--loop") && i + 1 < argc) {
+        const char *name = argv[++i];
+        if (0 == strcmp(name, loopBackendNames[LOOP_URING]))
+          backend = LOOP_URING;
+        else if (0 != strcmp(name, loopBackendNames[LOOP_EPOLL])) {
+          usage(argv[0]);
+          return 1;
+        }
+      }
+      else if (0 == strcmp(argv[i], "--record") && i + 1 < argc)
+        recordPath = argv[++i];
+      else if (0 == strcmp(argv[i], "--replay") && i + 1 < argc)
+        replayPath = argv[++i];
+      else if (0 == strcmp(argv[i], "--speed") && i + 1 < argc)
+        gReplay.speed = atof(argv[++i]);
+      else {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    if (recordPath && replayPath) {
+      usage(argv[0]);
+      return 1;
+    }
+
   /* === For libconfuse to handle config files === */
     /* Localize messages & types according to environment, since v2.9 */
 #ifdef LC_MESSAGES 
@@ -61,73 +366,181 @@ int main( void/* int argc, char *argv[]*/ )
     // return Fl::run();
 
     const char *filename = (char *)"tourbox.conf";
-    std::string ss = "/dev/tty";
-    ss.append(parse_conf(filename));
+    keymap *bootKeymap = new keymap;
+    const std::string tty = loadConfig(filename, *bootKeymap);   // mmap'd image unless stale
+    retireKeymap(swapKeymap(bootKeymap));
     printf("tourbox.conf parsed\n\n");
 
-    // Setup and open a serial port 
-    const int serialPortFileDescriptor = open(ss.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
-    if (serialPortFileDescriptor == -1)
-    {
-        std::cerr << "Failed to open serial port: " << ss << std::endl;
-        std::cerr << "Did you forget to plug in the TourBox?"  << std::endl;
-        exit(serialPortFileDescriptor);
+    // Every device section, or just the tty key if there are none. A replay
+    // has one stream of bytes, so it feeds one device.
+    std::vector<device_config> devices = currentKeymap().devices;
+    if (devices.empty() || replayPath != nullptr)
+        devices.assign(1, {"", tty, ""});
+    if (ttyPath != nullptr)
+        devices[0].tty = ttyPath;  // e.g. the slave side of a pty
+    for (const auto &dev : devices) {
+        tourbox_device &device = gDevices[gDeviceCount++];
+        device.name = dev.name;
+        device.link.port.path = ('/' == dev.tty[0]) ? dev.tty : "/dev/tty" + dev.tty;
+        device.link.port.options = currentKeymap().serial;
+        if (dev.profile.empty() || dev.profile == filename)
+            continue;
+        unsigned p = 0;
+        while (p < gProfileCount && gProfiles[p].path != dev.profile)
+            p++;
+        if (p == gProfileCount) {  // First device on this profile: load it
+            keymap *profileKeymap = new keymap;
+            if ("0" == loadConfig(dev.profile.c_str(), *profileKeymap)) {
+                std::cerr << "Device " << dev.name << " falls back to " << filename << std::endl;
+                delete profileKeymap;
+                continue;
+            }
+            gProfiles[p].path = dev.profile;
+            retireKeymap(swapKeymap(profileKeymap, gProfiles[p].map));
+            gProfileCount++;
+            printf("%s parsed\n", dev.profile.c_str());
+        }
+        device.driver.profile = &gProfiles[p].map;
     }
 
-    struct termios term_options;
-    memset(&term_options, 0, sizeof(struct termios));
+    // Forked now, while we are small and hold no devices or threads
+    if (spawnerStart(gSpawner, &gLatency) != 0)
+        std::cerr << "exec actions unavailable" << std::endl;
 
-    term_options.c_cflag = B115200 | CS8 | CREAD;
+    if (replayPath != nullptr)
+    {
+        if (!traceOpenRead(gReplay.trace, replayPath))
+            exit(5);
+        printf("Replaying %s at %s\n", replayPath, gReplay.speed > 0.0 ? "recorded pace" : "full speed");
+    }
+    else
+    {
+        for (unsigned i = 0; i < gDeviceCount; i++)
+        {
+            openSerial(gDevices[i].link.port);
+            serialPrint(gDevices[i].link.port);
+        }
+        if (recordPath != nullptr && !traceOpenWrite(gRecord, recordPath, monotonicNs()))
+            exit(5);
+    }
 
-    if ((tcsetattr(serialPortFileDescriptor, TCSANOW, &term_options)) != 0)
+    /// Setup the virtual drivers, or wherever --sink says reports go. Each
+    /// device gets its own, so they can be told apart.
+    for (unsigned i = 0; i < gDeviceCount; i++)
     {
-        std::cerr << "Failed to set termios settings";
-        close(serialPortFileDescriptor);
-        exit(2);
+        tourbox_device &device = gDevices[i];
+        std::string spec = sinkSpec;
+        if (0 == spec.compare(0, 5, "file:") && i > 0)
+            spec += "." + std::to_string(i);   // One file per device
+        if (sinkOpen(device.sink, spec.c_str(), currentKeymap(*device.driver.profile), device.name.c_str()) != 0)
+        {
+            std::cerr << "No output for reports; --sink null runs without uinput" << std::endl;
+            exit(6);
+        }
     }
 
-    if ((tcflush(serialPortFileDescriptor, TCIOFLUSH)) != 0)
+    if (loopInit(gLoop, backend) < 0)
+        exit(4);
+    if (LOOP_URING == gLoop.backend)
     {
-        std::cerr << "Failed to flush termios settings";
-        close(serialPortFileDescriptor);
-        exit(3);
+        printf("Event loop on io_uring\n");
+        for (unsigned i = 0; i < gDeviceCount; i++)
+            sinkAttach(gDevices[i].sink, gLoop);
+    }
+
+    // Signals go through the loop too, to make sure virtual device gets cleaned up
+    const int signalFileDescriptor = signalOpen({SIGINT, SIGTERM, SIGHUP, SIGUSR1});
+    loopAdd(gLoop, signalFileDescriptor, EPOLLIN, onSignal, nullptr);
+    if (wheelInit(gWheel, gLoop) != 0)
+        std::cerr << "Macro timers unavailable" << std::endl;
+    const bool spawner = gSpawner.sock >= 0 && spawnerAttach(gSpawner, gLoop) == 0;
+    const bool hotplug = replayPath == nullptr && hotplugInit(gHotplug, gLoop, &gLatency) == 0;
+    if (replayPath == nullptr && !hotplug)
+        std::cerr << "Unplugging a TourBox will stop the driver" << std::endl;
+    for (unsigned i = 0; i < gDeviceCount; i++)
+    {
+        // All devices share the one loop, wheel and spawner
+        tourbox_device &device = gDevices[i];
+        if (threads && replayPath == nullptr)
+        {
+            if (readerInit(device.reader, gLoop, driverChunks, &device.driver, realtime.priority) == 0)
+                device.driver.reader = &device.reader;
+            else
+                std::cerr << "Reading " << device.link.port.path << " on the loop thread" << std::endl;
+        }
+        driverInit(device.driver, gLoop, device.link.port.fd, &device.sink, &gLatency,
+                   gWheel.handler ? &gWheel : nullptr);
+        if (spawner)
+            device.driver.spawner = &gSpawner;
+        device.link.driver = &device.driver;
+        if (hotplug)
+            hotplugAdd(gHotplug, device.link);
+        if (gDeviceCount > 1)
+            printf("%s on %s\n", device.name.c_str(), device.link.port.path.c_str());
     }
+    if (recordPath != nullptr)
+        gDevices[0].driver.record = &gRecord;
+    if (replayPath != nullptr)
+    {
+        gReplay.timerFd = timerOpen();
+        loopAdd(gLoop, gReplay.timerFd, EPOLLIN, onReplay, nullptr);
+        gReplay.startNs = monotonicNs();
+        replayArm();
+    }
+    if (reloadInit(gReloader, gLoop, filename) != 0)
+        std::cerr << "Config changes will need a restart" << std::endl;
+    for (unsigned p = 0; p < gProfileCount; p++)
+        if (reloadInit(gProfiles[p].reloader, gLoop, gProfiles[p].path.c_str(), gProfiles[p].map) != 0)
+            std::cerr << gProfiles[p].path << " changes will need a restart" << std::endl;
+    gControl.keys = uinputKeys(currentKeymap());   // What the activeKeymap devices were made with
+    if (controlSocket != "none" && controlStart(gControl, gLoop, controlSocket, onControl, nullptr) == 0)
+        printf("Listening on %s\n", controlSocket.c_str());
 
-    std::array<uint8_t, 1> readBuffer;
+    if (realtime.priority > 0 || realtime.cpu >= 0)
+        realtimeEnter(realtime);   // Last, so the control thread stays ordinary
 
-    /// Setup the virtual driver
-    gUinputFileDescriptor = setupUinput();
+    loopRun(gLoop);   // Sleeps until a tty (or a signal) has something for us
 
-    // Register signal handler to make sure virtual device gets cleaned up
-    signal(SIGINT, sigint_handler);
+    controlStop(gControl);
+    for (unsigned i = 0; i < gDeviceCount; i++)
+    {
+        driverDestroy(gDevices[i].driver);
+        readerDestroy(gDevices[i].reader);
+    }
+    wheelDestroy(gWheel);
+    spawnerStop(gSpawner);
+    reloadDestroy(gReloader);
+    for (unsigned p = 0; p < gProfileCount; p++)
+        reloadDestroy(gProfiles[p].reloader);
+    hotplugDestroy(gHotplug);
+    loopDestroy(gLoop);
 
-    struct timespec tim, tim2;
-    tim.tv_sec = 0;          // 0 seconds, plus
-    tim.tv_nsec = 25000000L; // 25 milliseconds
-    
-    int key;
-    ssize_t bytesRead = read(serialPortFileDescriptor, readBuffer.begin(),1);
-    while(0 <= bytesRead)   /* If there's a error accessing the buffer we dip out gracefuly...*/
+    printStats();
+    if (replayPath != nullptr)
     {
-      bytesRead = read(serialPortFileDescriptor, readBuffer.begin(),1); /* get some data */
-      if(0 < bytesRead) /* make sure they pressed a button (or nano sleep below) */
-      {
-        key = readBuffer[0];  /* use our KeyType to make it easier to read */
-        if (PINKIE == key      
-         || RING == key        // We are
-         || SIDE == key        // looking for    // looking for
-         || TOP == key){       // double clicks.
-            nanosleep(&tim, &tim2);     // Give them about 25ms to double click
-            bytesRead = read(serialPortFileDescriptor, readBuffer.begin(),1);
-            if(0 != bytesRead)                
-              key = readBuffer[0]; // Double click returns a different code from device.
-          }                                  // Only four of the buttons have this feature.
-          generateKeyPressEvent(gUinputFileDescriptor, key);
-      }                           // ..slow..down...
-      else                        //...........the.. 
-        nanosleep(&tim, &tim2);   // ............read..  
-    }                             // ..............buffer....
-    destroyUinput(gUinputFileDescriptor);
+        uint64_t events = 0;
+        for (unsigned i = 0; i < gDeviceCount; i++)
+            events += gDevices[i].driver.stats.events;
+        const double seconds = (monotonicNs() - gReplay.startNs) / 1e9;
+        printf("replay: %llu chunks, %llu bytes in %.3f s (%.0f events/s)\n",
+               (unsigned long long)gReplay.trace.chunks, (unsigned long long)gReplay.trace.bytes,
+               seconds, events / seconds);
+        traceClose(gReplay.trace);
+        close(gReplay.timerFd);
+    }
+    if (gRecord.f != nullptr)
+        printf("recorded %llu chunks, %llu bytes to %s\n",
+               (unsigned long long)gRecord.chunks, (unsigned long long)gRecord.bytes, recordPath);
+    traceClose(gRecord);
+    close(signalFileDescriptor);
+    for (unsigned i = 0; i < gDeviceCount; i++)
+    {
+        tourbox_device &device = gDevices[i];
+        serialClose(device.link.port);
+        if (SINK_MEMORY == device.sink.kind)
+            printf("captured %zu events in memory\n", device.sink.captured.size());
+        sinkClose(device.sink);
+    }
 
     return 0;
 }
@@ -0,0 +1,119 @@
+/*
+ * @file output_sink.h
+ * @brief Where finished input_event reports go. The batch hands complete
+ *        reports to a sink instead of a raw fd, so the same pipeline can
+ *        drive real uinput, throw everything away (decode/map throughput
+ *        on its own), log to a binary file, or capture in memory for
+ *        checks and benchmarks that should not pay for kernel delivery.
+ *        On an io_uring loop, uinput and file writes are queued on the
+ *        ring instead of being a write() each.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <unistd.h>
+#include <vector>
+#include "keymap.h"
+#include "event_loop.h"
+
+// uinput_helper.h, which includes this, does the device setup itself
+int setupUinput(const keymap &map, const char *label);
+void destroyUinput(int fd);
+
+enum sink_kind : uint8_t {
+    SINK_UINPUT = 0,
+    SINK_NULL,       // Counts and discards
+    SINK_FILE,       // Raw struct input_event records, as read from an evdev node
+    SINK_MEMORY,     // Appends to captured
+};
+
+static constexpr const char *sinkNames[] = {"uinput", "null", "file", "memory"};
+
+struct output_sink {
+    sink_kind kind = SINK_NULL;
+    int fd = -1;                              // uinput and file
+    event_loop *loop = nullptr;               // io_uring: writes go through its ring
+    int loopFile = -1;                        // fd's slot in the ring's file table
+    std::vector<struct input_event> captured; // memory
+    uint64_t events = 0;                      // Accepted by the backend
+};
+
+// Writes n events. Returns how many bytes the backend took, or -1 with
+// errno set, like write(); the batch retries short writes.
+ssize_t sinkWrite(output_sink &s, const struct input_event *ev, size_t n)
+{
+    ssize_t w = n * sizeof(*ev);
+    switch (s.kind) {
+      case SINK_UINPUT:
+      case SINK_FILE:
+        if (s.loop == nullptr || !loopWrite(*s.loop, s.loopFile, ev, w))
+            w = write(s.fd, ev, w);
+        break;
+      case SINK_NULL:
+        break;
+      case SINK_MEMORY:
+        s.captured.insert(s.captured.end(), ev, ev + n);
+        break;
+    }
+    if (w > 0)
+        s.events += w / sizeof(*ev);
+    return w;
+}
+
+// spec is "uinput", "null", "memory" or "file:PATH". Returns 0, or -1 if
+// the spec is unknown or its device/file could not be opened. A uinput
+// device advertises the keys in map and has label added to its name.
+int sinkOpen(output_sink &s, const char *spec, const keymap &map = currentKeymap(), const char *label = "")
+{
+    s = output_sink();
+    if (0 == strcmp(spec, "uinput")) {
+        s.kind = SINK_UINPUT;
+        s.fd = setupUinput(map, label);
+        return (s.fd >= 0) ? 0 : -1;
+    }
+    if (0 == strcmp(spec, "null")) {
+        s.kind = SINK_NULL;
+        return 0;
+    }
+    if (0 == strcmp(spec, "memory")) {
+        s.kind = SINK_MEMORY;
+        s.captured.reserve(4096);
+        return 0;
+    }
+    if (0 == strncmp(spec, "file:", 5) && spec[5] != '\0') {
+        s.kind = SINK_FILE;
+        s.fd = open(spec + 5, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (s.fd < 0)
+            perror(spec + 5);
+        return (s.fd >= 0) ? 0 : -1;
+    }
+    fprintf(stderr, "Unknown output sink: %s\n", spec);
+    return -1;
+}
+
+// Sends writes through loop's ring if it has one. Queued writes count as
+// taken; the loop tallies the few that fail.
+void sinkAttach(output_sink &s, event_loop &loop)
+{
+    s.loopFile = loopAddWriter(loop, s.fd);
+    s.loop = (s.loopFile >= 0) ? &loop : nullptr;
+}
+
+void sinkClose(output_sink &s)
+{
+    if (SINK_UINPUT == s.kind && s.fd >= 0)
+        destroyUinput(s.fd);
+    else if (SINK_FILE == s.kind && s.fd >= 0)
+        close(s.fd);
+    s.fd = -1;
+}
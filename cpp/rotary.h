@@ -0,0 +1,108 @@
+/*
+ * @file rotary.h
+ * @brief Velocity based acceleration for the scroll wheel, dial and knob.
+ *        The detent rate is measured from the time between bytes and run
+ *        through the curve in keymap::accel, so one fast spin covers a
+ *        large range while slow turns stay one step per detent. The result
+ *        is a step count the caller turns into a single scaled event (or
+ *        a burst of taps for key mappings) in one batch.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include "keymap.h"
+
+#define ROTARY_IDLE_NS   250000000ULL  // Slower than 4 detents/s starts over
+#define ROTARY_MIN_DT_NS   1000000ULL  // Shortest gap trusted as a rate sample
+#define ROTARY_SMOOTHING 0.5           // EWMA weight of the newest sample
+
+enum rotary_control : uint8_t {
+    ROTARY_WHEEL = 0,
+    ROTARY_DIAL,
+    ROTARY_KNOB,
+    ROTARY_COUNT,
+};
+
+struct rotary_state {
+    uint64_t lastNs = 0;
+    double rate = 0.0;        // Detents per second, smoothed
+    double remainder = 0.0;   // Fractional steps carried to the next detent
+    int8_t direction = 0;
+};
+
+struct rotary_engine {
+    std::array<rotary_state, ROTARY_COUNT> controls;
+};
+
+// Which control a rotary code belongs to and which way it turned.
+bool rotaryControl(uint8_t code, rotary_control &control, int8_t &direction)
+{
+    switch (code) {
+        case WHEEL_UP:     control = ROTARY_WHEEL; direction = 1;  return true;
+        case WHEEL_DOWN:   control = ROTARY_WHEEL; direction = -1; return true;
+        case DIAL_CLOCK:   control = ROTARY_DIAL;  direction = 1;  return true;
+        case DIAL_COUNTER: control = ROTARY_DIAL;  direction = -1; return true;
+        case KNOB_CLOCK:   control = ROTARY_KNOB;  direction = 1;  return true;
+        case KNOB_COUNTER: control = ROTARY_KNOB;  direction = -1; return true;
+    }
+    return false;
+}
+
+// Steps per detent at a given rate.
+double accelGain(const accel_curve &curve, double rate)
+{
+    if (!curve.enabled || rate <= curve.threshold)
+        return 1.0;
+    const double gain = 1.0 + curve.gain * std::pow(rate - curve.threshold, curve.exponent);
+    return (gain > curve.max) ? curve.max : gain;
+}
+
+// Feeds one detent read at nowNs and returns what it is worth in steps,
+// unquantised. Hi-res scrolling uses this directly.
+double rotaryAdvance(rotary_engine &engine, const accel_curve &curve, uint8_t code, uint64_t nowNs, bool precise)
+{
+    rotary_control control;
+    int8_t direction;
+    if (!rotaryControl(code, control, direction))
+        return 1.0;
+
+    rotary_state &s = engine.controls[control];
+    const uint64_t dt = nowNs - s.lastNs;
+    if (0 == s.lastNs || dt > ROTARY_IDLE_NS || direction != s.direction) {
+        s.rate = 0.0;        // Fresh turn, or a reversal: no momentum
+        s.remainder = 0.0;
+    } else if (dt > 0) {     // Detents read in one burst share nowNs and say nothing of rate
+        const double sample = 1e9 / (double)(dt < ROTARY_MIN_DT_NS ? ROTARY_MIN_DT_NS : dt);
+        s.rate += ROTARY_SMOOTHING * (sample - s.rate);
+    }
+    s.lastNs = nowNs;
+    s.direction = direction;
+
+    if (!curve.enabled)
+        return 1.0;
+    return precise ? curve.precision : accelGain(curve, s.rate);
+}
+
+// Same, quantised to whole steps (0 is possible in precision mode, the
+// fraction is carried over to the next detent).
+int rotaryStep(rotary_engine &engine, const accel_curve &curve, uint8_t code, uint64_t nowNs, bool precise)
+{
+    const double gain = rotaryAdvance(engine, curve, code, nowNs, precise);
+    rotary_control control;
+    int8_t direction;
+    if (!rotaryControl(code, control, direction))
+        return 1;
+
+    rotary_state &s = engine.controls[control];
+    s.remainder += gain;
+    const int steps = (int)s.remainder;
+    s.remainder -= steps;
+    return steps;
+}
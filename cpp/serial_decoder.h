@@ -0,0 +1,134 @@
+/*
+ * @file serial_decoder.h
+ * @brief Bulk serial reads into a fixed-size ring buffer, and a streaming
+ *        decoder that turns the buffered bytes into press/release events
+ *        in a single pass. One read() drains whatever the tty has, so a
+ *        fast spin of the dial costs one syscall per burst, not per byte.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "keymap.h"
+
+#define SERIAL_RING_SIZE 512   // Must stay a power of two
+
+struct decoder_stats {
+    uint64_t reads = 0;        // readv() calls that returned data
+    uint64_t bytes = 0;        // bytes accepted into the ring
+    uint64_t events = 0;       // press/release events decoded
+    uint64_t unknown = 0;      // bytes that are not a TourBox code
+    uint64_t overflow = 0;     // bytes dropped because the ring was full
+};
+
+struct byte_ring {
+    std::array<uint8_t, SERIAL_RING_SIZE> buf;
+    uint32_t head = 0;   // next write, free running
+    uint32_t tail = 0;   // next read, free running
+};
+
+inline uint32_t ringUsed(const byte_ring &r) { return r.head - r.tail; }
+inline uint32_t ringFree(const byte_ring &r) { return SERIAL_RING_SIZE - ringUsed(r); }
+inline bool ringEmpty(const byte_ring &r) { return r.head == r.tail; }
+inline uint8_t ringPeek(const byte_ring &r) { return r.buf[r.tail & (SERIAL_RING_SIZE - 1)]; }
+inline uint8_t ringPop(byte_ring &r) { return r.buf[r.tail++ & (SERIAL_RING_SIZE - 1)]; }
+
+// Reads everything available from fd into the ring with a single readv(),
+// covering the wrap-around with a second iovec. If the ring is already full
+// the bytes are still drained from the tty (so epoll stops reporting it)
+// but only counted as overflow.
+// Returns the number of bytes read, 0 on EOF, or -1 with errno set.
+ssize_t ringFill(byte_ring &r, int fd, decoder_stats &stats)
+{
+    const uint32_t space = ringFree(r);
+    if (0 == space) {
+        std::array<uint8_t, 64> scratch;
+        const ssize_t n = read(fd, scratch.data(), scratch.size());
+        if (n > 0)
+            stats.overflow += n;
+        return n;
+    }
+
+    const uint32_t start = r.head & (SERIAL_RING_SIZE - 1);
+    const uint32_t first = (SERIAL_RING_SIZE - start) < space ? (SERIAL_RING_SIZE - start) : space;
+
+    struct iovec iov[2];
+    iov[0].iov_base = r.buf.data() + start;
+    iov[0].iov_len = first;
+    iov[1].iov_base = r.buf.data();
+    iov[1].iov_len = space - first;
+
+    const ssize_t n = readv(fd, iov, (space > first) ? 2 : 1);
+    if (n > 0) {
+        r.head += n;
+        stats.reads++;
+        stats.bytes += n;
+    }
+    return n;
+}
+
+// Copies bytes that did not come from a read() (a replayed trace, another
+// thread) into the ring, with the same accounting as ringFill().
+void ringPush(byte_ring &r, const uint8_t *data, uint32_t n, decoder_stats &stats)
+{
+    const uint32_t space = ringFree(r);
+    const uint32_t take = (n < space) ? n : space;
+    for (uint32_t i = 0; i < take; i++)
+        r.buf[r.head++ & (SERIAL_RING_SIZE - 1)] = data[i];
+    stats.reads++;
+    stats.bytes += take;
+    stats.overflow += n - take;
+}
+
+/* === Byte classification === */
+
+enum byte_kind : uint8_t {
+    BYTE_UNKNOWN = 0,
+    BYTE_PRESS,
+    BYTE_RELEASE,
+};
+
+// Controls that send a second byte on release send the press code with the
+// high bit set ([49][c9], [22][a2], ...). A press code always wins if the
+// two ever collide.
+constexpr std::array<uint8_t, 256> makeByteKinds()
+{
+    std::array<uint8_t, 256> kinds = {};
+    for (const auto &figure : keyfig)
+        kinds[figure.code] = BYTE_PRESS;
+    for (const auto &figure : keyfig)
+        if (!(figure.code & 0x80) && BYTE_UNKNOWN == kinds[figure.code | 0x80])
+            kinds[figure.code | 0x80] = BYTE_RELEASE;
+    return kinds;
+}
+
+static constexpr std::array<uint8_t, 256> byteKinds = makeByteKinds();
+
+// Release bytes are reported with the press code they belong to.
+typedef void (*decode_callback)(uint8_t code, byte_kind kind, void *ctx);
+
+// Decodes every byte in the ring in one pass. The callback may itself pop
+// bytes (e.g. to pair a follow-up byte with the current one); the loop
+// re-checks the ring after each event.
+void decodeStream(byte_ring &r, decoder_stats &stats, decode_callback cb, void *ctx)
+{
+    while (!ringEmpty(r)) {
+        const uint8_t b = ringPop(r);
+        const byte_kind kind = static_cast<byte_kind>(byteKinds[b]);
+        if (BYTE_UNKNOWN == kind) {
+            stats.unknown++;
+            continue;
+        }
+        stats.events++;
+        cb(BYTE_RELEASE == kind ? (b & 0x7f) : b, kind, ctx);
+    }
+}
@@ -0,0 +1,187 @@
+/*
+ * @file serial_port.h
+ * @brief A TourBox's tty: opened non-blocking, put in raw mode at any baud
+ *        rate through termios2, VMIN/VTIME set so bytes are handed over
+ *        the moment they arrive, ASYNC_LOW_LATENCY asked for, and flushed.
+ *        Everything applied is read back and compared, since tty drivers
+ *        are free to ignore or round what they are given. Used at startup
+ *        and again every time a device comes back after being unplugged.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "keymap.h"
+
+// The kernel's struct termios2. Its header clashes with glibc's
+// <termios.h>, and glibc's struct termios has a different c_cc size, so
+// it is spelled out here for the TCGETS2/TCSETS2 ioctls.
+struct serial_termios2 {
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+
+#define SERIAL_TCGETS2 _IOR('T', 0x2A, struct serial_termios2)
+#define SERIAL_TCSETS2 _IOW('T', 0x2B, struct serial_termios2)
+#define SERIAL_BOTHER  0010000   // c_cflag: the rate is in c_ispeed/c_ospeed
+
+enum serial_error {
+    SERIAL_OPEN_FAILED = -1,
+    SERIAL_TERMIOS_FAILED = -2,
+    SERIAL_FLUSH_FAILED = -3,
+};
+
+// What the port says it is doing, read back after setting it up.
+struct serial_settings {
+    uint32_t ispeed = 0;
+    uint32_t ospeed = 0;
+    uint8_t vmin = 0;
+    uint8_t vtime = 0;
+    bool raw = false;             // No canonical mode, echo, signals or translation
+    bool lowLatency = false;
+    bool lowLatencyKnown = false; // The driver answers TIOCGSERIAL at all
+};
+
+struct serial_port {
+    std::string path;
+    int fd = -1;
+    serial_options options;
+    serial_settings applied;
+    uint64_t mismatches = 0;      // Settings the driver did not take, over every open
+};
+
+// ASYNC_LOW_LATENCY lets a driver push received bytes to the line
+// discipline without waiting for the next flip buffer work. Drivers
+// without serial_struct support (cdc-acm on some kernels, ptys) just
+// report nothing.
+void serialSetLowLatency(serial_port &p)
+{
+    struct serial_struct ss;
+    p.applied.lowLatencyKnown = false;
+    if (ioctl(p.fd, TIOCGSERIAL, &ss) != 0)
+        return;
+    if (((ss.flags & ASYNC_LOW_LATENCY) != 0) != p.options.lowLatency) {
+        ss.flags ^= ASYNC_LOW_LATENCY;
+        if (ioctl(p.fd, TIOCSSERIAL, &ss) != 0 || ioctl(p.fd, TIOCGSERIAL, &ss) != 0)
+            return;
+    }
+    p.applied.lowLatencyKnown = true;
+    p.applied.lowLatency = (ss.flags & ASYNC_LOW_LATENCY) != 0;
+}
+
+// Raw 8N1 at options.baud. BOTHER takes any rate, standard or not, so
+// there is no Bnnn table to keep.
+int serialConfigure(serial_port &p)
+{
+    struct serial_termios2 tio;
+    if (ioctl(p.fd, SERIAL_TCGETS2, &tio) != 0)
+        return SERIAL_TERMIOS_FAILED;
+    tio.c_iflag = 0;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | SERIAL_BOTHER;
+    tio.c_ispeed = tio.c_ospeed = p.options.baud;
+    memset(tio.c_cc, 0, sizeof(tio.c_cc));
+    tio.c_cc[VMIN] = p.options.vmin;
+    tio.c_cc[VTIME] = p.options.vtime;
+    if (ioctl(p.fd, SERIAL_TCSETS2, &tio) != 0)
+        return SERIAL_TERMIOS_FAILED;
+    serialSetLowLatency(p);
+    return 0;
+}
+
+// Reads the settings back. Returns how many differ from what was asked
+// for; each one is reported, none is fatal.
+unsigned serialVerify(serial_port &p)
+{
+    struct serial_termios2 tio;
+    if (ioctl(p.fd, SERIAL_TCGETS2, &tio) != 0) {
+        fprintf(stderr, "%s: cannot read termios back: %s\n", p.path.c_str(), strerror(errno));
+        return 1;
+    }
+    serial_settings &a = p.applied;
+    a.ispeed = tio.c_ispeed;
+    a.ospeed = tio.c_ospeed;
+    a.vmin = tio.c_cc[VMIN];
+    a.vtime = tio.c_cc[VTIME];
+    a.raw = 0 == (tio.c_lflag & (ICANON | ECHO | ISIG | IEXTEN)) && 0 == (tio.c_iflag & (ICRNL | IXON | ISTRIP))
+         && 0 == (tio.c_oflag & OPOST) && CS8 == (tio.c_cflag & CSIZE);
+
+    unsigned bad = 0;
+    if (a.ospeed != p.options.baud || a.ispeed != p.options.baud) {
+        fprintf(stderr, "%s: asked for %u baud, got %u/%u\n", p.path.c_str(), p.options.baud, a.ispeed, a.ospeed);
+        bad++;
+    }
+    if (a.vmin != p.options.vmin || a.vtime != p.options.vtime) {
+        fprintf(stderr, "%s: asked for VMIN %u VTIME %u, got %u %u\n", p.path.c_str(),
+                p.options.vmin, p.options.vtime, a.vmin, a.vtime);
+        bad++;
+    }
+    if (!a.raw) {
+        fprintf(stderr, "%s: did not go into raw mode\n", p.path.c_str());
+        bad++;
+    }
+    if (a.lowLatencyKnown && a.lowLatency != p.options.lowLatency) {
+        fprintf(stderr, "%s: low latency flag did not stick\n", p.path.c_str());
+        bad++;
+    }
+    p.mismatches += bad;
+    return bad;
+}
+
+// Opens, configures, verifies and flushes p.path. Returns the fd (also
+// left in p.fd), or a serial_error with errno set.
+int serialOpen(serial_port &p)
+{
+    p.fd = open(p.path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (p.fd < 0)
+        return SERIAL_OPEN_FAILED;
+
+    int err = serialConfigure(p);
+    if (0 == err) {
+        serialVerify(p);
+        if (tcflush(p.fd, TCIOFLUSH) != 0)   // Whatever queued up before we were ready
+            err = SERIAL_FLUSH_FAILED;
+    }
+    if (err != 0) {
+        const int saved = errno;
+        close(p.fd);
+        p.fd = -1;
+        errno = saved;
+        return err;
+    }
+    return p.fd;
+}
+
+void serialClose(serial_port &p)
+{
+    if (p.fd >= 0)
+        close(p.fd);
+    p.fd = -1;
+}
+
+void serialPrint(const serial_port &p)
+{
+    printf("%s: %u baud, VMIN %u VTIME %u, low latency %s\n", p.path.c_str(), p.applied.ospeed,
+           p.applied.vmin, p.applied.vtime,
+           !p.applied.lowLatencyKnown ? "not supported" : p.applied.lowLatency ? "on" : "off");
+}
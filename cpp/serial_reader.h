@@ -0,0 +1,217 @@
+/*
+ * @file serial_reader.h
+ * @brief Optional reader thread for a TourBox's tty (--threads). It does
+ *        nothing but wait for bytes, read them and stamp them, and hands
+ *        each read to the event loop as one cache line through a
+ *        lock-free queue and an eventfd. The loop then decodes, maps and
+ *        writes as usual, so a slow uinput write() or a burst of macro
+ *        work delays reports but never the read that timestamps them.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <poll.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include "event_loop.h"
+#include "latency.h"
+#include "spsc_queue.h"
+
+#define READER_QUEUE_SIZE  256   // Chunks in flight, must stay a power of two
+#define READER_CHUNK_BYTES 55    // What fits in a cache line next to the header
+#define READER_LOST        0xff  // Chunk length: the tty went away, nothing follows
+
+// One read(). Exactly a cache line, so neighbouring slots never share one.
+struct alignas(64) reader_chunk {
+    uint64_t readNs = 0;
+    uint8_t len = 0;
+    uint8_t bytes[READER_CHUNK_BYTES];
+};
+static_assert(sizeof(reader_chunk) == 64, "reader_chunk should fill one cache line");
+
+struct serial_reader {
+    int ttyFd = -1;
+    int wakeFd = -1;             // eventfd: chunks are waiting for the loop
+    int stopFd = -1;             // eventfd: the loop wants the thread back
+    int roomFd = -1;             // eventfd: the loop emptied a full queue
+    std::atomic<bool> waiting{false};   // The thread sleeps on roomFd
+    int priority = 0;            // --realtime: SCHED_FIFO for the thread too
+    std::thread thread;
+    event_loop *loop = nullptr;
+    loop_handler *handler = nullptr;
+    spsc_queue<reader_chunk, READER_QUEUE_SIZE> queue;   // reader -> loop
+};
+
+void readerWake(serial_reader &r)
+{
+    const uint64_t one = 1;
+    if (write(r.wakeFd, &one, sizeof(one)) != sizeof(one))
+        perror("reader: eventfd");
+}
+
+// A full queue means the loop is behind. Nothing is dropped: the thread
+// wakes the loop and sleeps until readerRoom() says it drained the queue,
+// while the tty buffers, so a stalled loop costs latency, never input.
+// False once asked to stop.
+bool readerPost(serial_reader &r, const reader_chunk &chunk)
+{
+    while (!spscPush(r.queue, chunk)) {
+        r.waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);   // Pairs with readerRoom()
+        if (spscPush(r.queue, chunk)) {   // Drained before it could see the flag
+            r.waiting.store(false, std::memory_order_relaxed);
+            return true;
+        }
+        readerWake(r);
+        struct pollfd fds[2];
+        fds[0] = {r.roomFd, POLLIN, 0};
+        fds[1] = {r.stopFd, POLLIN, 0};
+        if (poll(fds, 2, -1) < 0 && EINTR != errno) {
+            perror("reader: poll");
+            return false;
+        }
+        if (fds[1].revents & POLLIN)
+            return false;
+        uint64_t count;
+        if (fds[0].revents & POLLIN && read(r.roomFd, &count, sizeof(count)) != sizeof(count))
+            perror("reader: eventfd");
+    }
+    return true;
+}
+
+// Called by the loop after it popped everything: lets a thread blocked on
+// a full queue go on.
+void readerRoom(serial_reader &r)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);   // Pops before the flag
+    if (!r.waiting.load(std::memory_order_relaxed) || !r.waiting.exchange(false))
+        return;
+    const uint64_t one = 1;
+    if (write(r.roomFd, &one, sizeof(one)) != sizeof(one))
+        perror("reader: eventfd");
+}
+
+void readerThread(serial_reader *r)
+{
+    if (r->priority > 0) {       // Threads started after realtimeEnter() are reset to SCHED_OTHER
+        struct sched_param param = {};
+        param.sched_priority = r->priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0)
+            perror("reader: SCHED_FIFO");
+    }
+    for (;;) {
+        struct pollfd fds[2];
+        fds[0] = {r->ttyFd, POLLIN, 0};
+        fds[1] = {r->stopFd, POLLIN, 0};
+        if (poll(fds, 2, -1) < 0) {
+            if (EINTR == errno)
+                continue;
+            perror("reader: poll");
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            return;
+
+        bool lost = (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+        bool posted = false;
+        for (;;) {               // Drain the tty, one chunk per read()
+            reader_chunk chunk;
+            const ssize_t n = read(r->ttyFd, chunk.bytes, sizeof(chunk.bytes));
+            if (n > 0) {
+                chunk.readNs = monotonicNs();
+                chunk.len = n;
+                if (!readerPost(*r, chunk))
+                    return;
+                posted = true;
+                continue;
+            }
+            if (0 > n && EINTR == errno)
+                continue;
+            if (0 > n && EAGAIN != errno)
+                lost = true;     // EIO once the TourBox is unplugged
+            break;               // Drained (VMIN=0 ttys say so with 0)
+        }
+        if (lost)
+            break;
+        if (posted)
+            readerWake(*r);
+    }
+    reader_chunk gone;           // Tell the loop, after whatever came before it
+    gone.readNs = monotonicNs();
+    gone.len = READER_LOST;
+    if (readerPost(*r, gone))
+        readerWake(*r);
+}
+
+// The loop side: onChunks runs on the loop thread whenever chunks are waiting.
+int readerInit(serial_reader &r, event_loop &loop, loop_callback onChunks, void *ctx, int priority = 0)
+{
+    r.loop = &loop;
+    r.priority = priority;
+    r.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r.stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r.roomFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r.wakeFd < 0 || r.stopFd < 0 || r.roomFd < 0) {
+        perror("reader: eventfd");
+        return -1;
+    }
+    r.handler = loopAdd(loop, r.wakeFd, EPOLLIN, onChunks, ctx);
+    return (r.handler != nullptr) ? 0 : -1;
+}
+
+// Starts reading ttyFd, which must be non-blocking. Again after every
+// reconnect; the queue and the loop's handler stay as they are.
+int readerStart(serial_reader &r, int ttyFd)
+{
+    if (r.handler == nullptr || r.thread.joinable())
+        return -1;
+    r.ttyFd = ttyFd;
+    r.thread = std::thread(readerThread, &r);
+    return 0;
+}
+
+// Waits for the thread to let go of the tty; the caller closes it. Chunks
+// it had not handed over yet are dropped with it.
+void readerStop(serial_reader &r)
+{
+    if (r.thread.joinable()) {
+        const uint64_t one = 1;
+        if (write(r.stopFd, &one, sizeof(one)) != sizeof(one))
+            perror("reader: eventfd");
+        r.thread.join();
+        uint64_t count;
+        if (read(r.stopFd, &count, sizeof(count)) != sizeof(count))   // Ready for the next start
+            perror("reader: eventfd");
+    }
+    reader_chunk chunk;
+    while (spscPop(r.queue, chunk))
+        ;
+    uint64_t count;
+    if (read(r.roomFd, &count, sizeof(count)) < 0 && EAGAIN != errno)   // A wakeup nobody took
+        perror("reader: eventfd");
+    r.waiting.store(false, std::memory_order_relaxed);
+    r.ttyFd = -1;
+}
+
+void readerDestroy(serial_reader &r)
+{
+    readerStop(r);
+    if (r.loop != nullptr)
+        loopRemove(*r.loop, r.handler);
+    r.handler = nullptr;
+    for (int *fd : {&r.wakeFd, &r.stopFd, &r.roomFd})
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+}
@@ -0,0 +1,70 @@
+/*
+ * @file spsc_queue.h
+ * @brief Bounded single-producer, single-consumer queue. One thread
+ *        pushes, one pops, and neither ever locks or blocks: a full queue
+ *        makes push fail and an empty one makes pop fail. Used wherever
+ *        two threads hand work to each other. Each side's index sits on
+ *        its own cache line with a private copy of the other side's, so
+ *        the shared lines only move between cores when the cached copy
+ *        says the queue looks full (or empty).
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+template <typename T, size_t N>
+struct spsc_queue {
+    static_assert(N && !(N & (N - 1)), "capacity must be a power of two");
+    alignas(64) std::atomic<size_t> head{0};   // Next slot to pop, owned by the consumer
+    size_t tailCache = 0;                      // Consumer's last look at tail
+    alignas(64) std::atomic<size_t> tail{0};   // Next slot to push, owned by the producer
+    size_t headCache = 0;                      // Producer's last look at head
+    std::atomic<size_t> highWater{0};          // Most items ever queued at once
+    std::atomic<uint64_t> overflow{0};         // Pushes refused because it was full
+    alignas(64) std::array<T, N> slots;
+};
+
+// The counters are written by the producer only, so a relaxed
+// load-and-store is enough and other threads may read them any time.
+template <typename T, size_t N>
+bool spscPush(spsc_queue<T, N> &q, const T &item)
+{
+    const size_t tail = q.tail.load(std::memory_order_relaxed);
+    if (tail - q.headCache == N) {
+        q.headCache = q.head.load(std::memory_order_acquire);
+        if (tail - q.headCache == N) {
+            q.overflow.store(q.overflow.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    q.slots[tail & (N - 1)] = item;
+    q.tail.store(tail + 1, std::memory_order_release);
+    if (tail + 1 - q.headCache > q.highWater.load(std::memory_order_relaxed)) {
+        q.headCache = q.head.load(std::memory_order_acquire);   // Only a fresh look sets a record
+        if (tail + 1 - q.headCache > q.highWater.load(std::memory_order_relaxed))
+            q.highWater.store(tail + 1 - q.headCache, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+template <typename T, size_t N>
+bool spscPop(spsc_queue<T, N> &q, T &item)
+{
+    const size_t head = q.head.load(std::memory_order_relaxed);
+    if (head == q.tailCache) {
+        q.tailCache = q.tail.load(std::memory_order_acquire);
+        if (head == q.tailCache)
+            return false;
+    }
+    item = q.slots[head & (N - 1)];
+    q.head.store(head + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,199 @@
+/*
+ * @file timer_wheel.h
+ * @brief Two-level hashed timer wheel on a single timerfd, for the many
+ *        short deadlines macros create. Adding, cancelling and firing a
+ *        timer are O(1); ticks with nothing due cost a bitmap test. The
+ *        timerfd is only armed for the next occupied slot, so an idle
+ *        wheel never wakes the loop.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include "event_loop.h"
+#include "latency.h"
+
+#define WHEEL_BITS     8
+#define WHEEL_SLOTS    (1u << WHEEL_BITS)
+#define WHEEL_MASK     (WHEEL_SLOTS - 1)
+#define WHEEL_TICK_NS  1000000L                              // 1 ms
+#define WHEEL_MAX_TICKS ((WHEEL_SLOTS - 1) * WHEEL_SLOTS)    // ~65 s; longer waits are clamped
+
+struct wheel_timer;
+typedef void (*wheel_callback)(wheel_timer &t, void *ctx);
+
+// Intrusive: the owner embeds this and the wheel only links it in.
+struct wheel_timer {
+    wheel_timer *next = nullptr;
+    wheel_timer **pprev = nullptr;   // Set while armed
+    uint64_t expires = 0;            // Absolute tick
+    uint8_t level = 0;
+    uint8_t slot = 0;
+    wheel_callback cb = nullptr;
+    void *ctx = nullptr;
+};
+
+struct timer_wheel {
+    std::array<std::array<wheel_timer *, WHEEL_SLOTS>, 2> slots = {};
+    std::array<std::bitset<WHEEL_SLOTS>, 2> used;
+    uint64_t now = 0;                // Last tick processed
+    uint64_t baseNs = 0;
+    uint64_t pending = 0;
+    uint64_t fired = 0;
+    bool running = false;            // Inside wheelRun(), callbacks may add timers
+    int timerFd = -1;
+    loop_handler *handler = nullptr;
+    event_loop *loop = nullptr;
+};
+
+inline bool wheelArmed(const wheel_timer &t) { return t.pprev != nullptr; }
+
+inline uint64_t wheelTickNow(const timer_wheel &w)
+{
+    return (monotonicNs() - w.baseNs) / WHEEL_TICK_NS;
+}
+
+void wheelLink(timer_wheel &w, wheel_timer &t)
+{
+    const uint64_t delta = t.expires - w.now;
+    t.level = (delta < WHEEL_SLOTS) ? 0 : 1;
+    t.slot = (t.level ? (t.expires >> WHEEL_BITS) : t.expires) & WHEEL_MASK;
+    wheel_timer *&head = w.slots[t.level][t.slot];
+    t.next = head;
+    if (head != nullptr)
+        head->pprev = &t.next;
+    head = &t;
+    t.pprev = &head;
+    w.used[t.level].set(t.slot);
+}
+
+void wheelUnlink(timer_wheel &w, wheel_timer &t)
+{
+    *t.pprev = t.next;
+    if (t.next != nullptr)
+        t.next->pprev = t.pprev;
+    if (w.slots[t.level][t.slot] == nullptr)
+        w.used[t.level].reset(t.slot);
+    t.next = nullptr;
+    t.pprev = nullptr;
+}
+
+// Arms the timerfd for the first occupied level 0 slot, or for the next
+// cascade if only level 1 has work.
+void wheelSchedule(timer_wheel &w)
+{
+    if (0 == w.pending) {
+        timerDisarm(w.timerFd);
+        return;
+    }
+    uint64_t next = w.now + (WHEEL_SLOTS - (w.now & WHEEL_MASK));   // Next cascade
+    for (uint64_t tick = w.now + 1; tick < next; tick++)
+        if (w.used[0].test(tick & WHEEL_MASK)) {
+            next = tick;
+            break;
+        }
+    const uint64_t dueNs = w.baseNs + next * WHEEL_TICK_NS;
+    const uint64_t nowNs = monotonicNs();
+    timerArm(w.timerFd, (dueNs > nowNs) ? dueNs - nowNs : 1);
+}
+
+void wheelCancel(timer_wheel &w, wheel_timer &t)
+{
+    if (!wheelArmed(t))
+        return;
+    wheelUnlink(w, t);
+    w.pending--;
+}
+
+// Walks w.now up to `target`, firing what is due and pulling the next
+// lap of level 1 down as it passes. An idle wheel just jumps there.
+void wheelRun(timer_wheel &w, uint64_t target)
+{
+    w.running = true;
+    while (w.now < target && w.pending > 0) {
+        w.now++;
+        const unsigned slot = w.now & WHEEL_MASK;
+        if (0 == slot) {           // Pull the next lap of level 1 down
+            const unsigned upper = (w.now >> WHEEL_BITS) & WHEEL_MASK;
+            wheel_timer *t = w.slots[1][upper];
+            w.slots[1][upper] = nullptr;
+            w.used[1].reset(upper);
+            while (t != nullptr) {
+                wheel_timer *next = t->next;
+                wheelLink(w, *t);
+                t = next;
+            }
+        }
+        while (w.used[0].test(slot)) {   // Callbacks may re-add, even here
+            wheel_timer &t = *w.slots[0][slot];
+            if (t.expires > w.now)
+                break;                   // Shouldn't happen: slots hold one lap
+            wheelUnlink(w, t);
+            w.pending--;
+            w.fired++;
+            t.cb(t, t.ctx);
+        }
+    }
+    if (0 == w.pending)
+        w.now = target;
+    w.running = false;
+}
+
+// Fires t's callback after `ms` milliseconds (at least one tick). w.now
+// only moves when the timerfd fires, so it is caught up first; timers
+// that were already due may fire from in here.
+void wheelAdd(timer_wheel &w, wheel_timer &t, uint32_t ms)
+{
+    wheelCancel(w, t);
+    const uint64_t tick = wheelTickNow(w);
+    if (!w.running)
+        wheelRun(w, tick);
+    uint64_t ticks = (uint64_t)ms * 1000000L / WHEEL_TICK_NS;
+    if (ticks < 1)
+        ticks = 1;
+    if (ticks > WHEEL_MAX_TICKS)
+        ticks = WHEEL_MAX_TICKS;
+    t.expires = tick + ticks;
+    if (t.expires - w.now > WHEEL_MAX_TICKS)   // From a callback while the run is still behind
+        t.expires = w.now + WHEEL_MAX_TICKS;
+    wheelLink(w, t);
+    w.pending++;
+    if (!w.running)
+        wheelSchedule(w);
+}
+
+void onWheelTick(loop_handler &h, uint32_t /*events*/)
+{
+    timer_wheel &w = *static_cast<timer_wheel *>(h.ctx);
+    if (0 == timerAck(h.fd))
+        return;
+    wheelRun(w, wheelTickNow(w));
+    wheelSchedule(w);
+}
+
+int wheelInit(timer_wheel &w, event_loop &loop)
+{
+    w.loop = &loop;
+    w.baseNs = monotonicNs();
+    w.timerFd = timerOpen();
+    if (w.timerFd < 0)
+        return -1;
+    w.handler = loopAdd(loop, w.timerFd, EPOLLIN, onWheelTick, &w);
+    return (w.handler != nullptr) ? 0 : -1;
+}
+
+void wheelDestroy(timer_wheel &w)
+{
+    if (w.loop != nullptr)
+        loopRemove(*w.loop, w.handler);
+    w.handler = nullptr;
+    if (w.timerFd >= 0)
+        close(w.timerFd);
+    w.timerFd = -1;
+}
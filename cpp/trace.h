@@ -0,0 +1,133 @@
+/*
+ * @file trace.h
+ * @brief Compact binary traces of the raw serial byte stream, for
+ *        --record and --replay. Each chunk is what one read returned:
+ *        a LEB128 varint of nanoseconds since the previous chunk, a
+ *        length byte and the bytes themselves. Replaying a trace feeds
+ *        the same decoder and keymap path the tty does, so timing bugs
+ *        can be reproduced and benchmarked without a TourBox attached.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "serial_decoder.h"
+
+#define TRACE_MAGIC   "TBXTRACE"
+#define TRACE_VERSION 1
+#define TRACE_CHUNK_MAX 255
+
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t startNs;     // CLOCK_MONOTONIC of the first chunk, for reference
+};
+
+struct trace_file {
+    FILE *f = nullptr;
+    uint64_t lastNs = 0;  // Absolute (record) or offset (replay) of the previous chunk
+    uint64_t chunks = 0;
+    uint64_t bytes = 0;
+};
+
+bool traceOpenWrite(trace_file &t, const char *path, uint64_t startNs)
+{
+    t.f = fopen(path, "wb");
+    if (t.f == nullptr) {
+        perror(path);
+        return false;
+    }
+    trace_header header = {};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.startNs = startNs;
+    t.lastNs = startNs;
+    return fwrite(&header, sizeof(header), 1, t.f) == 1;
+}
+
+void traceWriteVarint(FILE *f, uint64_t v)
+{
+    do {
+        uint8_t b = v & 0x7f;
+        v >>= 7;
+        if (v)
+            b |= 0x80;
+        fputc(b, f);
+    } while (v);
+}
+
+// Logs the n bytes that landed in the ring at `from` (a free-running
+// index, as ringFill() leaves in head). stdio buffers it, so recording
+// adds no syscalls to the read path until the buffer fills.
+void traceRecord(trace_file &t, uint64_t nowNs, const byte_ring &r, uint32_t from, uint32_t n)
+{
+    while (n > 0) {
+        const uint32_t len = (n > TRACE_CHUNK_MAX) ? TRACE_CHUNK_MAX : n;
+        traceWriteVarint(t.f, nowNs - t.lastNs);
+        t.lastNs = nowNs;
+        fputc(len, t.f);
+        for (uint32_t i = 0; i < len; i++)
+            fputc(r.buf[(from + i) & (SERIAL_RING_SIZE - 1)], t.f);
+        from += len;
+        n -= len;
+        t.chunks++;
+        t.bytes += len;
+    }
+}
+
+bool traceOpenRead(trace_file &t, const char *path)
+{
+    t.f = fopen(path, "rb");
+    if (t.f == nullptr) {
+        perror(path);
+        return false;
+    }
+    trace_header header;
+    if (fread(&header, sizeof(header), 1, t.f) != 1
+     || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+     || TRACE_VERSION != header.version) {
+        fprintf(stderr, "%s: not a version %i TourBox trace\n", path, TRACE_VERSION);
+        fclose(t.f);
+        t.f = nullptr;
+        return false;
+    }
+    t.lastNs = 0;
+    return true;
+}
+
+// Reads the next chunk into buf (TRACE_CHUNK_MAX bytes). offsetNs is its
+// time since the start of the trace. Returns the length, 0 at the end.
+int traceNext(trace_file &t, uint64_t &offsetNs, uint8_t *buf)
+{
+    uint64_t delta = 0;
+    int c;
+    for (unsigned shift = 0; ; shift += 7) {
+        if ((c = fgetc(t.f)) == EOF || shift > 63)
+            return 0;
+        delta |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            break;
+    }
+    const int len = fgetc(t.f);
+    if (len <= 0 || fread(buf, 1, len, t.f) != (size_t)len)
+        return 0;
+    t.lastNs += delta;
+    offsetNs = t.lastNs;
+    t.chunks++;
+    t.bytes += len;
+    return len;
+}
+
+void traceClose(trace_file &t)
+{
+    if (t.f != nullptr)
+        fclose(t.f);
+    t.f = nullptr;
+}
@@ -19,6 +19,8 @@
  * @copyright Copyright (c) 2022
  *
 */
+#pragma once
+
 #include <sys/select.h>
 #define DEBUG
 
@@ -31,6 +33,8 @@
 
 
 #include <array>
+#include <bitset>
+#include <cmath>
 #include <asm-generic/ioctl.h>
 #include <charconv>
 #include <climits>
@@ -47,245 +51,202 @@
 #include <confuse.h>
 #include <utility>
 
-#define DBL_TOP      0x13 
-#define DBL_RING     0x18   // Some keys report double click 
-#define DBL_PINKIE   0x1c 
-#define DBL_SIDE     0x21 
-
-#define NINTENDO_B   0x22    // Two small cyircles near Tourbox logo. 
-#define NINTENDO_A   0x23 
-#define MOON         0x2a    // Next to tall knob 
-#define RING         0x80 
-#define SIDE         0x81    // Various small buttons 
-#define TOP          0x82 
-#define PINKIE       0x83   // On bottom right 
-
-#define WHEEL_DOWN    0x09 
-#define WHEEL_PRESS   0x0a 
-#define WHEEL_UP      0x49  // Large Mouse wheel 
-
-#define DPAD_UP      0x90   // Four arrows. 
-#define DPAD_DOWN    0x91 
-#define DPAD_LEFT    0x92 
-#define DPAD_RIGHT   0x93 
-
-#define DIAL_PRESS    0x38 
-#define DIAL_COUNTER  0x4f 
-#define DIAL_CLOCK    0x8f   // Large flat disc 
-
-#define KNOB_PRESS    0x37 
-#define KNOB_CLOCK    0x44   // Central knob 
-#define KNOB_COUNTER  0x84 
+#include "keymap.h"
+#include "latency.h"
+#include "output_sink.h"
     
 using namespace std;
 
-static cfg_t *cfg;
-
-struct keyfigure {
-  cfg_bool_t flag = cfg_false;
-  int rel = 1;
-  std::string tstr = "";
-  int kcode = 0;
-  std::string kstr = "";
-  std::string exec = "";
-  keyfigure () : flag(cfg_false), rel(1), tstr(""), kcode(0), kstr(""), exec("") {}; 
-  keyfigure (cfg_bool_t a, int b, std::string d, int e, string f) 
-    : flag(a), rel(b), tstr(d), kcode(e), kstr(f), exec("") {};
+#define EVENT_BATCH_MAX 64   // 16 taps worth of down/SYN/up/SYN
+
+// Events for one or more reports, flushed to the sink with a single write().
+struct event_batch {
+    std::array<struct input_event, EVENT_BATCH_MAX> events;
+    std::array<uint64_t, EVENT_BATCH_MAX> readNs;   // When each event's byte was read
+    size_t count = 0;
+    size_t synced = 0;   // events up to and including the last SYN_REPORT
+    output_sink *sink = nullptr;
+    uint64_t writes = 0;
+    uint64_t stampNs = 0;              // Read time for events queued next
+    latency_stats *latency = nullptr;  // Optional, records write and read->emit
 };
 
-/*static array<keyfigure, 24> keyfig = 
-{{{ false,  1,  NINTENDO_B,      "NINTENDO_B",      KEY_CAMERA_ACCESS_DISABLE, "KEY_CAMERA_ACCESS_DISABLE", "0" },
-  { false,  1,  NINTENDO_A,      "NINTENDO_A",      KEY_CAMERA_ACCESS_ENABLE,  "KEY_CAMERA_ACCESS_ENABLE",  "0" },
-  { false,  1,  SIDE,            "SIDE",            KEY_CALC,                  "KEY_CALC",                  "0" },
-  { false,  1,  TOP,             "TOP",             KEY_REFRESH,               "KEY_REFRESH",               "0" },
-  { false,  1,  PINKIE,          "PINKIE",          KEY_FORWARD,               "KEY_FORWARD",               "0" },
-  { false,  1,  RING,            "RING",            KEY_BACK,                  "KEY_BACK",                  "0" },
-  { false,  1,  MOON,            "MOON",            KEY_FORWARD,               "KEY_FORWARD",               "0" },
-  { false,  1,  WHEEL_UP,        "WHEEL_UP",        REL_WHEEL,                 "REL_WHEEL",                 "0" },
-  { false,  1,  WHEEL_DOWN,      "WHEEL_DOWN",      REL_WHEEL,                 "REL_WHEEL",                 "0" },
-  { false,  1,  WHEEL_PRESS,     "WHEEL_PRESS",     KEY_HOME,                  "KEY_HOME",                  "0" },
-  { false,  1,  DPAD_UP,         "DPAD_UP",         KEY_UP,                    "KEY_UP",                    "0" },
-  { false,  1,  DPAD_DOWN,       "DPAD_DOWN",       KEY_DOWN,                  "KEY_DOWN",                  "0" },
-  { false,  1,  DPAD_LEFT,       "DPAD_LEFT",       KEY_LEFT,                  "KEY_LEFT",                  "0" },
-  { false,  1,  DPAD_RIGHT,      "DPAD_RIGHT",      KEY_RIGHT,                 "KEY_RIGHT",                 "0" },
-  { false,  1,  DIAL_CLOCK,      "DIAL_CLOCK",      KEY_BRIGHTNESSUP,          "KEY_BRIGHTNESSUP",          "0" },
-  { false,  1,  DIAL_COUNTER,    "DIAL_COUNTER",    KEY_BRIGHTNESSDOWN,        "KEY_BRIGHTNESSDOWN",        "0" },
-  { false,  1,  DIAL_PRESS,      "DIAL_PRESS",      KEY_MICMUTE,               "KEY_MICMUTE",               "0" },
-  { false,  1,  KNOB_CLOCK,      "KNOB_CLOCK",      KEY_VOLUMEUP,              "KEY_VOLUMEUP",              "0" },
-  { false,  1,  KNOB_COUNTER,    "KNOB_COUNTER",    KEY_VOLUMEDOWN,            "KEY_VOLUMEDOWN",            "0" },
-  { false,  1,  KNOB_PRESS,      "KNOB_PRESS",      KEY_PLAYPAUSE,             "KEY_PLAYPAUSE",             "0" },
-  { false,  1,  DBL_RING,        "DBL_RING",        KEY_CAMERA,                "KEY_CAMERA",                "0" },
-  { false,  1,  DBL_PINKIE,      "DBL_PINKIE",      KEY_ALL_APPLICATIONS,      "KEY_ALL_APPLICATIONS",      "0" },
-  { false,  1,  DBL_SIDE,        "DBL_SIDE",        KEY_SLEEP,                 "KEY_SLEEP",                 "0" },
-  { false,  1,  DBL_TOP,         "DBL_TOP",         KEY_SCREENLOCK,            "KEY_SCREENLOCK",            "0" }}};
-*/
-
-
-static std::map<int, keyfigure> keyfig = 
-   {{{NINTENDO_A},      {cfg_false , 1, "NINTENDO_A",      KEY_CAMERA_ACCESS_ENABLE,  "KEY_CAMERA_ACCESS_ENABLE"}},
-    {{NINTENDO_B},      {cfg_false , 1, "NINTENDO_B",      KEY_CAMERA_ACCESS_DISABLE,  "KEY_CAMERA_ACCESS_DISABLE"}},
-    {{SIDE},            {cfg_false , 1, "SIDE",            KEY_CALC,                  "KEY_CALC"}},
-    {{TOP},             {cfg_false , 1, "TOP",             KEY_REFRESH,               "KEY_REFRESH"}},
-    {{PINKIE},          {cfg_false , 1, "PINKIE",          KEY_FORWARD,               "KEY_FORWARD"}},
-    {{RING},            {cfg_false , 1, "RING",            KEY_BACK,                  "KEY_BACK"}},
-    {{MOON},            {cfg_false , 1, "MOON",            KEY_FORWARD,               "KEY_FORWARD"}},
-    {{WHEEL_UP},        {cfg_false , 1, "WHEEL_UP",        REL_WHEEL,                 "REL_WHEEL"}},
-    {{WHEEL_DOWN},      {cfg_false , 1, "WHEEL_DOWN",      REL_WHEEL,                 "REL_WHEEL"}},
-    {{WHEEL_PRESS},     {cfg_false , 1, "WHEEL_PRESS",     KEY_HOME,                  "KEY_HOME"}},
-    {{DPAD_UP},         {cfg_false , 1, "DPAD_UP",         KEY_UP,                    "KEY_UP"}},
-    {{DPAD_DOWN},       {cfg_false , 1, "DPAD_DOWN",       KEY_DOWN,                  "KEY_DOWN"}},
-    {{DPAD_LEFT},       {cfg_false , 1, "DPAD_LEFT",       KEY_LEFT,                  "KEY_LEFT"}},
-    {{DPAD_RIGHT},      {cfg_false , 1, "DPAD_RIGHT",      KEY_RIGHT,                 "KEY_RIGHT"}},
-    {{DIAL_CLOCK},      {cfg_false , 1, "DIAL_CLOCK",      KEY_BRIGHTNESSUP,          "KEY_BRIGHTNESSUP"}},
-    {{DIAL_COUNTER},    {cfg_false , 1, "DIAL_COUNTER",    KEY_BRIGHTNESSDOWN,        "KEY_BRIGHTNESSDOWN"}},
-    {{DIAL_PRESS},      {cfg_false , 1, "DIAL_PRESS",      KEY_MICMUTE,               "KEY_MICMUTE"}},
-    {{KNOB_CLOCK},      {cfg_false , 1, "KNOB_CLOCK",      KEY_VOLUMEUP,              "KEY_VOLUMEUP"}},
-    {{KNOB_COUNTER},    {cfg_false , 1, "KNOB_COUNTER",    KEY_VOLUMEDOWN,            "KEY_VOLUMEDOWN"}},
-    {{KNOB_PRESS},      {cfg_false , 1, "KNOB_PRESS",      KEY_PLAYPAUSE,             "KEY_PLAYPAUSE"}},
-    {{DBL_RING},        {cfg_false , 1, "DBL_RING",        KEY_CAMERA,                "KEY_CAMERA"}},
-    {{DBL_PINKIE},      {cfg_false , 1, "DBL_PINKIE",      KEY_ALL_APPLICATIONS,      "KEY_ALL_APPLICATIONS"}},
-    {{DBL_SIDE},        {cfg_false , 1, "DBL_SIDE",        KEY_SLEEP,                 "KEY_SLEEP"}},
-    {{DBL_TOP},         {cfg_false , 1, "DBL_TOP",         KEY_SCREENLOCK,            "KEY_SCREENLOCK"}}};
-
-std::string parse_conf(const char *filename) 
+// Writes the first n queued events and shifts the rest down.
+void writeEvents(event_batch &batch, size_t n)
 {
-  cfg_opt_t key[] = {
-    CFG_BOOL("flag", cfg_false, CFGT_NONE),
-    CFG_INT("rel", 1, CFGT_NONE),
-    CFG_STR("exec", 0, CFGT_NONE),
-    CFG_END()
-  };
-
-  cfg_opt_t opts[] = {
-    CFG_FLOAT("VERSION", 0.0, CFGF_NONE),
-    CFG_STR("tty", "ACM1", CFGF_NONE),
-    CFG_SEC("key", key, CFGF_MULTI | CFGF_TITLE),
-    CFG_END()
-  };
-
-  cfg = cfg_init(opts, CFGF_NONE);
-  switch (cfg_parse(cfg, filename)) {
-	  case CFG_FILE_ERROR:
-	    printf("warning: configuration file '%s' could not be found: %s\n", filename, strerror(errno));
-	    return "0";
-	  case CFG_PARSE_ERROR:
-	    printf("warning: configuration file '%s' read error:  %s\n", filename, strerror(errno));
-	    return "0";
-    case CFG_SUCCESS:
-	    break;
-  }
- /* Iterate over the sections and print fields from each section. 
-D(	for (i = 0; i < cfg_size(cfg, "key"); i++) {
-		sec = cfg_getnsec(cfg, "key", i);
-
-			printf("group title:  '%s'\n", cfg_title(sec));
-			printf("group number:  %i\n", (int )cfg_getbool(sec, "flag"));
-			printf("group total:   %i\n", (int )cfg_getint(sec, "rel"));
-			printf("group exec :   %s\n", cfg_getstr(sec, "exec"));
-			printf("\n");
-	}
-
-  printf("cfg_size(cfg, \"key\") = %i", cfg_size(cfg, "key"));)
- // unsigned int j = 0;
-  std::string keystr, titstr;
-*/
-
- unsigned int i = 0;
-  cfg_t *sec = cfg_getnsec(cfg, "key", 0);
- 
-  for(auto& [kez, figure] : keyfig){
-    std::cout << "F loop: " << figure.kstr << "\t:\t" << cfg_size(cfg, "key") << std::endl;
-    for(i = 0; i < cfg_size(cfg, "key"); i++){
-		  sec = cfg_getnsec(cfg, "key", i);
-      std::cout << "\tI loop: " << i << "\t:\t" << cfg_getbool(sec, "flag") << std::endl;
-      std::cout << "\tTitle: " << cfg_title(sec) << "\t:\t" << figure.tstr << std::endl;
-      if((cfg_true == cfg_getbool(sec, "flag")) && (cfg_title(sec) == figure.tstr))
-      {
-        std::cout << "keyfig rel: " << cfg_getint(sec, "rel") << "\t" << cfg_getstr(sec, "exec") << std::endl;
-        figure.flag = cfg_true;
-        figure.rel = (int )cfg_getint(sec, "rel");
-        figure.exec = cfg_getstr(sec, "exec");
-        break;
-      }
+    const struct input_event *ev = batch.events.data();
+    size_t left = n;
+    const uint64_t startNs = batch.latency ? monotonicNs() : 0;
+    while (left > 0) {
+        const ssize_t w = sinkWrite(*batch.sink, ev, left);
+        if (w < 0 && EINTR == errno)
+            continue;
+        if (w < (ssize_t)sizeof(*ev))
+            break;           // Nothing sensible to do with a dead uinput fd
+        batch.writes++;
+        ev += w / sizeof(*ev);
+        left -= w / sizeof(*ev);
     }
-  }
-  
-  for (const auto& [kez, figure] : keyfig) {
-            std::cout << "Key: " << kez
-                  << " Active: " << figure.flag 
-                  << " Value1: " << figure.tstr
-                  << " Label: " << figure.kcode
-                  << " Description: " << figure.kstr
-                  << " Code: " << figure.exec
-                  << std::endl;
-  }
-  /*/
-  for (i = 0; i < cfg_size(cfg,"key"); i++) {
-    j = 0;
-    sec = cfg_getnsec(cfg, "key", i);
-    if(cfg_getbool(sec, "flag") == cfg_true){ure
-      while(keyfig[j].tstr != cfg_title(sec)){
-        keystr = keyfig[j].tstr;
-        titstr = cfg_title(sec);
-        j++;
-      }
-      std::string keystr = keyfig[j].tstr;
-      std::string titstr = cfg_title(sec);
-    	printf("j: %i\tkeyfig: %s\ttitle: %s", j, keystr.c_str(), titstr.c_str());	
-      keyfig[j].flag = true;
-      keyfig[j].rel = cfg_getint(sec, "rel");
-      keyfig[j].exec = cfg_getstr(sec, "exec");
+    if (batch.latency) {
+        const uint64_t doneNs = monotonicNs();
+        latencyRecord(*batch.latency, STAGE_WRITE, doneNs - startNs);
+        for (size_t i = 0; i < n; i++)   // One sample per report
+            if (EV_SYN == batch.events[i].type && batch.readNs[i])
+                latencyRecord(*batch.latency, STAGE_TOTAL, doneNs - batch.readNs[i]);
     }
-  }
-*/
-  return cfg_getstr(cfg, "tty");
+    batch.count -= n;
+    if (batch.count > 0) {
+        memmove(batch.events.data(), batch.events.data() + n, batch.count * sizeof(struct input_event));
+        memmove(batch.readNs.data(), batch.readNs.data() + n, batch.count * sizeof(uint64_t));
+    }
+    batch.synced = (batch.synced > n) ? batch.synced - n : 0;
 }
 
+void flushEvents(event_batch &batch)
+{
+    if (batch.synced > 0)
+        writeEvents(batch, batch.synced);
+}
 
-void emit(const int &fd, const int &type, const int &code, const int &val)
+void emit(event_batch &batch, const int &type, const int &code, const int &val)
 {
-    struct input_event ie;
+    if (EVENT_BATCH_MAX == batch.count)     // Full: push out complete reports only,
+        writeEvents(batch, batch.synced ? batch.synced : batch.count); // unless one report fills it
 
+    struct input_event &ie = batch.events[batch.count++];
     ie.type = type;
     ie.code = code;
     ie.value = val;
-    // timestamp values below are ignored 
-    ie.time.tv_sec = 0;
-    ie.time.tv_usec = 0;
+    // uinput restamps on delivery; ours is the CLOCK_MONOTONIC read time
+    ie.time.tv_sec = batch.stampNs / 1000000000ULL;
+    ie.time.tv_usec = (batch.stampNs % 1000000000ULL) / 1000;
+    batch.readNs[batch.count - 1] = batch.stampNs;
 
-    write(fd, &ie, sizeof(ie));
+    if (EV_SYN == type && SYN_REPORT == code)
+        batch.synced = batch.count;
 }
 
-void generateKeyPressEvent(const int &fd, int key)
-{   
+// Everything queued goes out, a report left open included, before the
+// sink goes away.
+void drainEvents(event_batch &batch)
+{
+    if (batch.count > batch.synced)
+        emit(batch, EV_SYN, SYN_REPORT, 0);
+    flushEvents(batch);
+}
 
-  keyfigure& keyf = keyfig[key];
-        if (WHEEL_DOWN == key)                // The mouse wheel has special re
-          emit(fd, EV_REL, REL_WHEEL, !(key.second.rel));  // relative properties which 
-        else if (WHEEL_UP == key)            // we implement here. 
-          emit(fd, EV_REL, REL_WHEEL, key.second.rel);  // (+ show for clarity)
-        else{
-          emit(fd, EV_KEY, key, key.second.rel); // Otherwise it's simple binary -
-          emit(fd, EV_SYN, SYN_REPORT, 0);   // Button down and button up.
-          emit(fd, EV_KEY, key, 0);
-        }
-       emit(fd, EV_SYN, SYN_REPORT, 0);     // Let's the kernel know you're done.
-      }
+// Queues the report(s) for one key. Nothing reaches uinput until
+// flushEvents(), so a whole decoded burst goes out in one write().
+void generateKeyPressEvent(event_batch &batch, const key_action &action)
+{   
+  switch (action.kind) {
+    case ACTION_NONE:                               // Unknown byte, nothing to say
+    case ACTION_LAYER:
+      return;
+    case ACTION_WHEEL:                              // The mouse wheel has special
+      emit(batch, EV_REL, action.code, action.rel); // relative properties (sign baked in)
+      break;
+    case ACTION_KEY:
+      emit(batch, EV_KEY, action.code, action.rel); // Otherwise it's simple binary -
+      emit(batch, EV_SYN, SYN_REPORT, 0);           // Button down and button up.
+      emit(batch, EV_KEY, action.code, 0);
+      break;
   }
+  emit(batch, EV_SYN, SYN_REPORT, 0);               // Let's the kernel know you're done.
+}
 
+// Queues an accelerated rotary detent worth `steps` steps. A wheel becomes
+// one scaled EV_REL; a key mapping becomes `steps` taps in the same batch.
+void generateRotaryEvent(event_batch &batch, const key_action &action, int steps)
+{
+  if (0 >= steps || ACTION_NONE == action.kind)
+    return;
+  if (ACTION_WHEEL == action.kind) {
+    emit(batch, EV_REL, action.code, action.rel * steps);
+    emit(batch, EV_SYN, SYN_REPORT, 0);
+    return;
   }
+  for (int i = 0; i < steps; i++)
+    generateKeyPressEvent(batch, action);
+}
+
+#define HIRES_PER_DETENT 120   // What the kernel counts as one legacy wheel click
+
+// Hi-res units owed to the legacy axis, per wheel axis.
+struct scroll_state {
+    std::array<int, 2> pending = {0, 0};   // REL_WHEEL, REL_HWHEEL
+};
+
+// Queues a wheel movement of `detents` (fractional when accelerated or in
+// precision mode) as REL_*_HI_RES in 120ths, plus the legacy REL_* click
+// whenever the hi-res total crosses a multiple of 120, in the same report.
+void generateScrollEvent(event_batch &batch, scroll_state &scroll, const key_action &action, double detents)
+{
+  if (ACTION_WHEEL != action.kind)
+    return;
+  const bool horizontal = (REL_HWHEEL == action.code);
+  const int hires = (int)lround(detents * action.rel * HIRES_PER_DETENT);
+  if (0 == hires)
+    return;
+
+  int &pending = scroll.pending[horizontal ? 1 : 0];
+  if ((pending < 0) != (hires < 0))     // Reversed: the old fraction is moot
+    pending = 0;
+  pending += hires;
+  const int clicks = pending / HIRES_PER_DETENT;   // Truncates toward zero
+  pending -= clicks * HIRES_PER_DETENT;
+
+  emit(batch, EV_REL, horizontal ? REL_HWHEEL_HI_RES : REL_WHEEL_HI_RES, hires);
+  if (0 != clicks)
+    emit(batch, EV_REL, action.code, clicks);
+  emit(batch, EV_SYN, SYN_REPORT, 0);
+}
+
+// Follows a real press or release of an ACTION_HOLD button: key down on
+// the press byte, key up on the release byte. A release for a key that
+// is not down (or a repeated press) sends nothing. The release lets go of
+// whatever the press sent, even if the layer has changed since.
+void generateKeyHoldEvent(event_batch &batch, key_state &state, int key, const key_action &action, bool pressed)
+{
+  if (state.held.test(key & 0xff) == pressed || (pressed && ACTION_KEY != action.kind))
+    return;
+  state.held.set(key & 0xff, pressed);
+  if (pressed)
+    state.sent[key & 0xff] = action.code;
+  emit(batch, EV_KEY, state.sent[key & 0xff], pressed ? action.rel : 0);
+  emit(batch, EV_SYN, SYN_REPORT, 0);
 }
 
-int setupUinput(void)
+// Every EV_KEY code a virtual device made for `map` advertises. Keys can't
+// be added once the device exists, and the kernel drops any other code.
+std::bitset<KEY_CNT> uinputKeys(const keymap &map)
+{
+    std::bitset<KEY_CNT> keys;
+    for (const auto &action : map.actions)
+      if (ACTION_KEY == action.kind)
+        keys.set(action.code);
+    for (const auto &layer : map.layers)
+      for (const auto &action : layer)
+        if (ACTION_KEY == action.kind)
+          keys.set(action.code);
+    for (const auto &step : map.macroSteps)  // Whatever macros send
+      if (step.code)
+        keys.set(step.code);
+    for (const auto &name : keyNames)     // Reloads and binds may want any
+      keys.set(name.code);
+    return keys;
+}
+
+int setupUinput(const keymap &map, const char *label)
 {
-    usleep(1000);
     int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if(fd){
-      ioctl(fd, UI_SET_EVBIT, EV_REP);     // Regular buttons
-	    for (int i = 0 ; i < 24 ; i++){
- //      D(printf("keyfig[%i].kode: %i\n",i,keyfig[i].kcode);) 
-        ioctl(fd, UI_SET_KEYBIT, keyfig[i].kcode); // Keyboard 
-      }
+    if (fd >= 0) {
+      ioctl(fd, UI_SET_EVBIT, EV_KEY);     // Regular buttons
+      ioctl(fd, UI_SET_EVBIT, EV_REP);
+      const std::bitset<KEY_CNT> keys = uinputKeys(map);
+      for (unsigned code = 0; code < KEY_CNT; code++)
+        if (keys.test(code))
+          ioctl(fd, UI_SET_KEYBIT, code);
 	    // ioctl(fd, UI_SET_KEYBIT, keyType.second); // Mouse 
       ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);  // /Clicky*
       ioctl(fd, UI_SET_KEYBIT, BTN_RIGHT); // /Clicky* !!
@@ -293,8 +254,10 @@ int setupUinput(void)
       ioctl(fd, UI_SET_EVBIT, EV_REL);      // Relative buttons
       ioctl(fd, UI_SET_RELBIT, REL_WHEEL);  // Vertical Wheel
       ioctl(fd, UI_SET_RELBIT, REL_HWHEEL); // Horizontal Wheel
-
-      usleep(1000);
+      if (map.hiresScroll) {           // Only advertise what we send, or
+        ioctl(fd, UI_SET_RELBIT, REL_WHEEL_HI_RES);  // libinput ignores REL_WHEEL
+        ioctl(fd, UI_SET_RELBIT, REL_HWHEEL_HI_RES);
+      }
 
       struct uinput_setup usetup;
       memset(&usetup, 0, sizeof(usetup));
@@ -302,13 +265,14 @@ int setupUinput(void)
       usetup.id.vendor = 0x2e3c; // Per 'lsusb -v' 
 
       usetup.id.product = 0x5740; // Might be different for you... 
-      strcpy(usetup.name, "Tourbox Neo Virtual Device Userland Driver (Keyboard/Mouse)");
+      snprintf(usetup.name, sizeof(usetup.name), "Tourbox Neo Virtual Device Userland Driver (Keyboard/Mouse)%s%s",
+               label[0] ? " " : "", label);   // Tells several TourBoxes apart
 
       ioctl(fd, UI_DEV_SETUP, &usetup);
       ioctl(fd, UI_DEV_CREATE);
     }
     else {
-      fprintf(stderr, "Unable to open /dev/uinput: %i\n", fd);
+      fprintf(stderr, "Unable to open /dev/uinput: %s\n", strerror(errno));
     }
     return fd;
 }
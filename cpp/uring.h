@@ -0,0 +1,184 @@
+/*
+ * @file uring.h
+ * @brief The little of io_uring the event loop needs, on the raw
+ *        syscalls: set up and map the rings, hand out submission entries,
+ *        submit-and-wait in one io_uring_enter(), walk the completions and
+ *        register buffers and files. No liburing, so no new dependency.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+*/
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct uring {
+    int fd = -1;
+    unsigned features = 0;
+    // Submission queue; the kernel reads up to *sqTail
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned sqLocal = 0;           // Tail of entries filled in but not published
+    struct io_uring_sqe *sqes = nullptr;
+    // Completion queue; we own *cqHead
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned cqMask = 0;
+    struct io_uring_cqe *cqes = nullptr;
+    void *ringMap = nullptr;
+    size_t ringSize = 0;
+    void *cqMap = nullptr;          // Only without IORING_FEAT_SINGLE_MMAP
+    size_t cqSize = 0;
+    size_t sqesSize = 0;
+};
+
+// The ring indices are shared with the kernel
+inline unsigned uringLoad(const unsigned *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline void uringStore(unsigned *p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+void uringDestroy(uring &r)
+{
+    if (r.sqes != nullptr)
+        munmap(r.sqes, r.sqesSize);
+    if (r.cqMap != nullptr)
+        munmap(r.cqMap, r.cqSize);
+    if (r.ringMap != nullptr)
+        munmap(r.ringMap, r.ringSize);
+    if (r.fd >= 0)
+        close(r.fd);
+    r = uring();
+}
+
+// Returns 0, or -1 with errno set: ENOSYS on kernels without io_uring,
+// EPERM where it is switched off, EINVAL where `flags` are too new.
+int uringInit(uring &r, unsigned entries, unsigned flags)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = flags;
+    r.fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r.fd < 0)
+        return -1;
+    r.features = p.features;
+
+    r.ringSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r.cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && r.cqSize > r.ringSize)
+        r.ringSize = r.cqSize;
+    r.sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    void *ring = mmap(nullptr, r.ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQ_RING);
+    void *cq = single ? ring
+             : mmap(nullptr, r.cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(nullptr, r.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQES);
+    r.ringMap = (ring != MAP_FAILED) ? ring : nullptr;
+    r.cqMap = (!single && cq != MAP_FAILED) ? cq : nullptr;
+    r.sqes = (sqes != MAP_FAILED) ? static_cast<struct io_uring_sqe *>(sqes) : nullptr;
+    if (ring == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        const int saved = errno;
+        uringDestroy(r);
+        errno = saved;
+        return -1;
+    }
+
+    char *sq = static_cast<char *>(ring);
+    r.sqHead = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    r.sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    r.sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    r.sqMask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    r.sqEntries = p.sq_entries;
+    r.sqLocal = *r.sqTail;
+    for (unsigned i = 0; i < r.sqEntries; i++)   // Entry i always sits in slot i
+        r.sqArray[i] = i;
+
+    char *c = static_cast<char *>(cq);
+    r.cqHead = reinterpret_cast<unsigned *>(c + p.cq_off.head);
+    r.cqTail = reinterpret_cast<unsigned *>(c + p.cq_off.tail);
+    r.cqMask = *reinterpret_cast<unsigned *>(c + p.cq_off.ring_mask);
+    r.cqes = reinterpret_cast<struct io_uring_cqe *>(c + p.cq_off.cqes);
+    return 0;
+}
+
+// Entries filled in that the kernel has not consumed yet.
+inline unsigned uringPending(const uring &r) { return r.sqLocal - uringLoad(r.sqHead); }
+
+// Publishes what was filled in, submits it and, with wait > 0, sleeps
+// until that many completions are there -- all in one syscall. With
+// IORING_SETUP_DEFER_TASKRUN, completions are only run while getting
+// events, so pass IORING_ENTER_GETEVENTS to run them without waiting.
+int uringEnter(uring &r, unsigned wait, unsigned flags = 0)
+{
+    const unsigned submit = uringPending(r);
+    uringStore(r.sqTail, r.sqLocal);
+    if (wait > 0)
+        flags |= IORING_ENTER_GETEVENTS;
+    return syscall(__NR_io_uring_enter, r.fd, submit, wait, flags, nullptr, 0);
+}
+
+// Same, but gives up waiting after timeoutNs: -1 with errno ETIME.
+int uringEnterTimeout(uring &r, unsigned wait, uint64_t timeoutNs)
+{
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeoutNs / 1000000000;
+    ts.tv_nsec = timeoutNs % 1000000000;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    const unsigned submit = uringPending(r);
+    uringStore(r.sqTail, r.sqLocal);
+    return syscall(__NR_io_uring_enter, r.fd, submit, wait, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                   &arg, sizeof(arg));
+}
+
+// Entries uringSqe() can hand out before it has to submit.
+inline unsigned uringSpace(const uring &r) { return r.sqEntries - uringPending(r); }
+
+// A cleared entry, or nullptr if the queue is full even after submitting
+// what is in it.
+struct io_uring_sqe *uringSqe(uring &r)
+{
+    if (r.sqLocal - uringLoad(r.sqHead) == r.sqEntries && uringEnter(r, 0) < 0)
+        return nullptr;
+    if (r.sqLocal - uringLoad(r.sqHead) == r.sqEntries)
+        return nullptr;
+    struct io_uring_sqe *sqe = &r.sqes[r.sqLocal++ & r.sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// The next completion, or nullptr. uringSeen() hands its slot back.
+inline struct io_uring_cqe *uringCqe(uring &r)
+{
+    const unsigned head = *r.cqHead;
+    return (head != uringLoad(r.cqTail)) ? &r.cqes[head & r.cqMask] : nullptr;
+}
+
+inline void uringSeen(uring &r) { uringStore(r.cqHead, *r.cqHead + 1); }
+
+int uringRegister(uring &r, unsigned opcode, const void *arg, unsigned count)
+{
+    return syscall(__NR_io_uring_register, r.fd, opcode, arg, count);
+}
+
+// Puts fd (or -1 to clear it) in slot `index` of the registered file table.
+int uringUpdateFile(uring &r, unsigned index, int fd)
+{
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = index;
+    update.fds = (uint64_t)(uintptr_t)&fd;
+    return (uringRegister(r, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1) ? 0 : -1;
+}
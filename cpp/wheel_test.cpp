@@ -0,0 +1,76 @@
+/**
+ * @file wheel_test.cpp
+ * @brief Regression test for the timer wheel: a wait added while another
+ *        timer is pending must still run its full length, on both event
+ *        loop backends. Exits non-zero on failure; run by ctest.
+ * @version 0.1.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c)2023
+ *
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <unistd.h>
+// Local
+#include "event_loop.h"
+#include "timer_wheel.h"
+#include "latency.h"
+
+struct wheel_probe {
+    event_loop *loop = nullptr;
+    uint64_t firedNs = 0;
+};
+
+void onProbe(wheel_timer & /*t*/, void *ctx)
+{
+    wheel_probe &p = *static_cast<wheel_probe *>(ctx);
+    p.firedNs = monotonicNs();
+    loopStop(*p.loop);
+}
+
+void onLong(wheel_timer & /*t*/, void * /*ctx*/)
+{
+}
+
+// Arms a 1000 ms timer, lets 300 ms pass without the loop running, then
+// waits 50 ms. The wheel used to count that from the tick it last ran,
+// so the wait fired straight away.
+bool waitWhilePending(loop_backend backend)
+{
+    event_loop loop;
+    timer_wheel wheel;
+    if (loopInit(loop, backend) < 0 || wheelInit(wheel, loop) != 0) {
+        perror("wheel_test: setup");
+        return false;
+    }
+    const char *name = (LOOP_URING == loop.backend) ? "io_uring" : "epoll";   // Falls back without io_uring
+    wheel_probe probe;
+    probe.loop = &loop;
+    wheel_timer longTimer, wait;
+    longTimer.cb = onLong;
+    wait.cb = onProbe;
+    wait.ctx = &probe;
+
+    wheelAdd(wheel, longTimer, 1000);
+    usleep(300 * 1000);
+    const uint64_t addedNs = monotonicNs();
+    wheelAdd(wheel, wait, 50);
+    loopRun(loop);
+
+    const double waitedMs = (probe.firedNs - addedNs) / 1e6;
+    const bool ok = waitedMs >= 49.0 && wheelArmed(longTimer);
+    printf("%s: 50 ms wait next to a pending timer took %.1f ms: %s\n", name, waitedMs, ok ? "ok" : "FAILED");
+    wheelCancel(wheel, longTimer);
+    wheelDestroy(wheel);
+    loopDestroy(loop);
+    return ok;
+}
+
+int main(void)
+{
+    bool ok = waitWhilePending(LOOP_EPOLL);
+    ok = waitWhilePending(LOOP_URING) && ok;
+    return ok ? 0 : 1;
+}